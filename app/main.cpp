@@ -1,12 +1,59 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
+#include <QQmlEngine>
 #include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
 #include "ui_controller.hpp"
+#include "graph_plot_item.hpp"
+#include <cstdlib>
+#include <new>
+
+#if TUX_PROFILE
+// Replacement global allocator feeding the overlay's Allocations counter, as tux_bench counts its own.
+// Only instrumented builds replace it; each form allocates straight from malloc() so each delete pairs with its new.
+namespace {
+void* countedAlloc(std::size_t size) noexcept {
+    TUX_PROFILE_COUNT(Allocations, 1);
+    return std::malloc(size ? size : 1);
+}
+} // namespace
+void* operator new(std::size_t size) {
+    if (void* p = countedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    if (void* p = countedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
 
 int main(int argc, char *argv[]) {
     QGuiApplication app(argc, argv);
+
+    // --trace FILE: capture every instrumented stage from launch and write Chrome trace JSON on exit
+    QString tracePath;
+    const QStringList args = app.arguments();
+    const qsizetype traceArg = args.indexOf("--trace");
+    if (traceArg > 0 && traceArg + 1 < args.size()) tracePath = args[traceArg + 1];
+
+    // --session FILE: the append-only session log to restore and keep writing (default: per-user app data)
+    QString sessionPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/session.tux";
+    const qsizetype sessionArg = args.indexOf("--session");
+    if (sessionArg > 0 && sessionArg + 1 < args.size()) sessionPath = args[sessionArg + 1];
     
+    // Native scene-graph plot used by Main.qml
+    qmlRegisterType<tux_ti83::GraphPlotItem>("TuxTI83", 1, 0, "GraphPlot");
+    qmlRegisterAnonymousType<tux_ti83::UIController>("TuxTI83", 1);
+
     // Create the engine first
     QQmlApplicationEngine engine;
     
@@ -15,6 +62,10 @@ int main(int argc, char *argv[]) {
     
     // EXPLICIT LINK: Register the controller BEFORE loading the file
     engine.rootContext()->setContextProperty("uiController", &uiController);
+
+    // Restore before QML binds to the display, history and viewport
+    QDir().mkpath(QFileInfo(sessionPath).absolutePath());
+    uiController.openSession(sessionPath);
     
     const QUrl url("qrc:/graph_ui/qml/Main.qml");
     
@@ -30,5 +81,12 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    if (!tracePath.isEmpty()) {
+        uiController.setTracing(true);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [tracePath]() {
+            if (!uiController.writeTrace(tracePath)) qDebug() << "Cannot write trace" << tracePath;
+        });
+    }
+
     return app.exec();
 }
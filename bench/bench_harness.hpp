@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace tux_ti83::bench {
+
+// Process-wide operator new counters (all threads), maintained by the replacement allocator in tux_bench.cpp.
+// Containers that allocate through malloc directly (Qt's QArrayData) are not seen.
+struct AllocCounters {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+};
+AllocCounters& allocCounters();
+
+// One timed operation; itemsPerOp scales the reported throughput ("items" are samples, flops, evaluations...)
+struct Case {
+    std::string name;
+    double itemsPerOp;
+    std::string itemUnit;
+    std::function<void()> op;
+};
+
+class Registry {
+public:
+    void add(std::string name, double itemsPerOp, std::string itemUnit, std::function<void()> op) {
+        m_cases.push_back({std::move(name), itemsPerOp, std::move(itemUnit), std::move(op)});
+    }
+    const std::vector<Case>& cases() const { return m_cases; }
+
+private:
+    std::vector<Case> m_cases;
+};
+
+// Keeps a computed value observable so the optimiser cannot drop the work that produced it
+template <class T> inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink; sink = &value;
+#endif
+}
+
+// UIController benchmarks live in bench_ui.cpp so the Qt dependency stays out of the core cases
+void registerUiBenchmarks(Registry& registry, int& argc, char** argv);
+
+} // namespace tux_ti83::bench
@@ -0,0 +1,44 @@
+#include "bench_harness.hpp"
+#include "ui_controller.hpp"
+#include <QGuiApplication>
+#include <memory>
+#include <string>
+
+namespace tux_ti83::bench {
+
+namespace {
+
+// Y1..Y3 typed through processInput exactly as the keypad would
+void enterFunctions(UIController& ui, int count) {
+    const std::vector<std::vector<QString>> keys = {
+        {"sin", "(", "X", ")", "×", "X"},
+        {"X", "^", "2", "÷", "4", "−", "3"},
+        {"√", "(", "X", "×", "X", "+", "1", ")", "+", "cos", "(", "2", "×", "X", ")"},
+    };
+    for (int f = 0; f < count; ++f) {
+        ui.setActiveFunction(f);
+        for (const auto& key : keys[f]) ui.processInput(key);
+    }
+    ui.setActiveFunction(0);
+}
+
+} // namespace
+
+void registerUiBenchmarks(Registry& registry, int& argc, char** argv) {
+    // Headless: the offscreen platform gives graph_ui a real QGuiApplication without a display server
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    static QGuiApplication app(argc, argv);
+
+    for (int functions : {1, 3}) {
+        auto ui = std::make_shared<UIController>();
+        enterFunctions(*ui, functions);
+        const std::string suffix = "/functions:" + std::to_string(functions);
+        for (int resolution : {100, 1000, 10000}) {
+            registry.add("ui/getMultiGraphPoints/res:" + std::to_string(resolution) + suffix, double(resolution + 1) * functions, "samples",
+                         [ui, resolution]() { doNotOptimize(ui->getMultiGraphPoints(resolution)); });
+        }
+        registry.add("ui/zoomFit" + suffix, 101.0 * functions, "samples", [ui]() { ui->resetViewport(); ui->zoomFit(); });
+    }
+}
+
+} // namespace tux_ti83::bench
@@ -0,0 +1,293 @@
+#include "bench_harness.hpp"
+#include "capsules/capsule_math.hpp"
+#include "capsules/capsule_sampler.hpp"
+#include "capsules/capsule_interval.hpp"
+#include "capsules/capsule_session.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef TUX_BUILD_TYPE
+#define TUX_BUILD_TYPE "unknown"
+#endif
+#ifdef __VERSION__
+#define TUX_COMPILER __VERSION__
+#else
+#define TUX_COMPILER "unknown"
+#endif
+
+// Replacement global allocator: every operator new in the process bumps the counters. Each form allocates
+// straight from malloc() rather than forwarding to another operator new, so each delete pairs with its new.
+namespace {
+void* countedAlloc(std::size_t size) noexcept {
+    auto& c = tux_ti83::bench::allocCounters();
+    c.count.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+} // namespace
+void* operator new(std::size_t size) {
+    if (void* p = countedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    if (void* p = countedAlloc(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace tux_ti83::bench {
+
+AllocCounters& allocCounters() {
+    static AllocCounters counters;
+    return counters;
+}
+
+namespace {
+
+using T = Token;
+
+struct Graph {
+    const char* name;
+    std::vector<Token> tokens;
+    bool scalar; // Has a scalar result, so the batch path applies
+};
+
+std::vector<Graph> representativeGraphs() {
+    return {
+        {"poly", {T::Num3, T::Mul, T::VarX, T::Pow, T::Num2, T::Add, T::Num2, T::Mul, T::VarX, T::Add, T::Num1}, true},
+        {"trig", {T::Sin, T::LeftParen, T::VarX, T::RightParen, T::Mul, T::Cos, T::LeftParen, T::VarX, T::RightParen}, true},
+        {"nested", {T::Sqrt, T::LeftParen, T::VarX, T::Pow, T::Num2, T::Add, T::Num1, T::RightParen, T::Div,
+                    T::LeftParen, T::Num1, T::Add, T::Ln, T::LeftParen, T::VarX, T::Mul, T::VarX, T::Add, T::Num1, T::RightParen, T::RightParen}, true},
+        {"logic", {T::LeftParen, T::VarX, T::Greater, T::Num0, T::RightParen, T::And, T::LeftParen, T::VarX, T::Less, T::Num5, T::RightParen}, true},
+        {"literal", {T::Num1, T::Num2, T::Decimal, T::Num5, T::Mul, T::Pi, T::Sub, T::Num3, T::Decimal, T::Num7, T::Num5}, true},
+        {"cse", {T::Sin, T::LeftParen, T::Pi, T::Div, T::Num4, T::RightParen, T::Mul, T::VarX, T::Pow, T::Num2,
+                 T::Add, T::Sin, T::LeftParen, T::Pi, T::Div, T::Num4, T::RightParen}, true},
+        {"matrix", {T::MatA, T::Mul, T::MatB, T::Add, T::MatA}, false},
+    };
+}
+
+Matrix randomMatrix(int rows, int cols, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::vector<double> values(static_cast<size_t>(rows) * cols);
+    for (auto& v : values) v = dist(rng);
+    return Matrix(rows, cols, std::move(values));
+}
+
+std::vector<double> linspace(double lo, double hi, size_t n) {
+    std::vector<double> xs(n);
+    for (size_t i = 0; i < n; ++i) xs[i] = lo + (hi - lo) * double(i) / double(n - 1);
+    return xs;
+}
+
+void registerCoreBenchmarks(Registry& registry) {
+    MathStateMachine::setMatrix(T::MatA, randomMatrix(3, 3, 1));
+    MathStateMachine::setMatrix(T::MatB, randomMatrix(3, 3, 2));
+
+    constexpr size_t kBatch = 4096;
+    auto xs = std::make_shared<std::vector<double>>(linspace(-10.0, 10.0, kBatch));
+    for (const auto& graph : representativeGraphs()) {
+        const std::string base = std::string("evaluate/") + graph.name;
+        auto tokens = std::make_shared<std::vector<Token>>(graph.tokens);
+        auto x = std::make_shared<double>(0.0);
+        registry.add(base + "/interpret", 1, "evaluations", [tokens, x]() {
+            MathStateMachine machine;
+            *x = *x > 10.0 ? -10.0 : *x + 0.01;
+            doNotOptimize(machine.evaluate(*tokens, *x));
+        });
+        auto compiled = std::make_shared<CompiledExpression>(graph.tokens);
+        registry.add(base + "/compiled", 1, "evaluations", [compiled, x]() {
+            *x = *x > 10.0 ? -10.0 : *x + 0.01;
+            doNotOptimize(compiled->evaluate(*x));
+        });
+        if (!graph.scalar) continue;
+        auto ys = std::make_shared<std::vector<double>>(kBatch);
+        registry.add(base + "/batch:" + std::to_string(kBatch), kBatch, "evaluations", [compiled, xs, ys]() {
+            compiled->evaluateBatch(*xs, *ys);
+            doNotOptimize(ys->data());
+        });
+        auto unoptimized = std::make_shared<CompiledExpression>(graph.tokens, false); // What optimizeProgram() buys
+        registry.add(base + "/batch:" + std::to_string(kBatch) + "/unoptimized", kBatch, "evaluations", [unoptimized, xs, ys]() {
+            unoptimized->evaluateBatch(*xs, *ys);
+            doNotOptimize(ys->data());
+        });
+    }
+
+    static const double kFractionInputs[] = {0.75, 1.0 / 3.0, 22.0 / 7.0, 0.1 + 0.2, -5.0 / 8.0, 3.14159265358979, 1234.5, 1e-7};
+    registry.add("toFraction/mixed", std::size(kFractionInputs), "values", []() {
+        for (double v : kFractionInputs) doNotOptimize(MathStateMachine::toFraction(v));
+    });
+
+    for (int n : {3, 16, 64, 256}) {
+        auto a = std::make_shared<Matrix>(randomMatrix(n, n, 3)), b = std::make_shared<Matrix>(randomMatrix(n, n, 4));
+        const std::string size = std::to_string(n) + "x" + std::to_string(n);
+        registry.add("matrixMul/" + size, 2.0 * n * n * n, "flops", [a, b]() { doNotOptimize(matrixMul(*a, *b)); });
+        registry.add("matrixAdd/" + size, double(n) * n, "elements", [a, b]() { doNotOptimize(matrixAdd(*a, *b)); });
+    }
+
+    for (size_t n : {1000, 1000000}) {
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<double> dist(-1.0, 1.0);
+        std::vector<double> values(n);
+        for (double& v : values) v = dist(rng);
+        auto list = std::make_shared<List>(std::move(values));
+        const std::string size = "/" + std::to_string(n);
+        registry.add("list/sum" + size, double(n), "elements", [list]() { doNotOptimize(listSum(*list)); });
+        registry.add("list/stdDev" + size, double(n), "elements", [list]() { doNotOptimize(listStdDev(*list)); });
+        registry.add("list/sortA" + size, double(n), "elements", [list]() { doNotOptimize(listSortA(*list)); });
+        registry.add("list/cumSum" + size, double(n), "elements", [list]() { doNotOptimize(listCumSum(*list)); });
+        registry.add("list/linReg" + size, double(n), "elements", [list]() { doNotOptimize(linearRegression(*list, *list)); });
+    }
+
+    // Startup cost of a session holding a 1M-element list, a matrix and a full history ring
+    auto sessionPath = std::make_shared<std::string>((std::filesystem::temp_directory_path() / "tux_bench_session.tux").string());
+    {
+        std::filesystem::remove(*sessionPath);
+        SessionLog log;
+        std::string error;
+        if (log.open(*sessionPath, error)) {
+            log.saveList(T::List1, List(std::vector<double>(1000000, 0.5)));
+            log.saveMatrix(T::MatA, randomMatrix(16, 16, 6));
+            for (int i = 0; i < 10000; ++i) log.saveHistory("Y1: 3+4 = " + std::to_string(i));
+        }
+    }
+    registry.add("session/open", 1, "opens", [sessionPath]() {
+        SessionLog log;
+        std::string error;
+        doNotOptimize(log.open(*sessionPath, error));
+    });
+
+    auto sampler = std::make_shared<ParallelSampler>();
+    auto functions = std::make_shared<std::vector<CompiledExpression>>();
+    for (const auto& graph : representativeGraphs())
+        if (graph.scalar && std::strcmp(graph.name, "literal") != 0 && std::strcmp(graph.name, "cse") != 0) functions->emplace_back(graph.tokens);
+    std::vector<const CompiledExpression*> pointers;
+    for (const auto& f : *functions) pointers.push_back(&f);
+    for (size_t n : {1000, 100000}) {
+        auto grid = std::make_shared<std::vector<double>>(linspace(-10.0, 10.0, n));
+        registry.add("sampler/uniform/samples:" + std::to_string(n), double(n) * pointers.size(), "samples", [sampler, functions, pointers, grid]() {
+            doNotOptimize(sampler->sample(pointers, *grid));
+        });
+    }
+    registry.add("sampler/adaptive/800x600", 800.0 * pointers.size(), "pixels", [sampler, functions, pointers]() {
+        doNotOptimize(sampler->sampleAdaptive(pointers, Viewport{-10, 10, -10, 10}, 800, 600));
+    });
+    AdaptiveOptions unguarded;
+    unguarded.intervalGuard = false; // What the interval guard costs
+    registry.add("sampler/adaptive/800x600/unguarded", 800.0 * pointers.size(), "pixels", [sampler, functions, pointers, unguarded]() {
+        doNotOptimize(sampler->sampleAdaptive(pointers, Viewport{-10, 10, -10, 10}, 800, 600, unguarded));
+    });
+    for (const auto& graph : representativeGraphs()) {
+        if (!graph.scalar) continue;
+        auto compiled = std::make_shared<CompiledExpression>(graph.tokens);
+        registry.add(std::string("boundRange/") + graph.name, 1, "ranges", [compiled]() { doNotOptimize(boundRange(*compiled, -10.0, 10.0)); });
+    }
+}
+
+struct Measurement {
+    uint64_t iterations = 0;
+    double seconds = 0;
+    uint64_t allocs = 0, bytes = 0;
+};
+
+// Doubles the iteration count (at most 10x per step) until one timed run lasts minSeconds, and reports that run
+Measurement measure(const Case& c, double minSeconds) {
+    c.op(); // Warm caches, lazily built state and the allocator
+    Measurement m;
+    uint64_t iterations = 1;
+    for (;;) {
+        auto& counters = allocCounters();
+        const uint64_t allocs0 = counters.count.load(), bytes0 = counters.bytes.load();
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) c.op();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        m = {iterations, elapsed, counters.count.load() - allocs0, counters.bytes.load() - bytes0};
+        if (elapsed >= minSeconds || iterations >= (uint64_t(1) << 40)) return m;
+        const double grow = elapsed > 0 ? std::min(10.0, std::max(2.0, 1.4 * minSeconds / elapsed)) : 10.0;
+        iterations = static_cast<uint64_t>(iterations * grow);
+    }
+}
+
+std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') out += '\\';
+        out += ch;
+    }
+    return out;
+}
+
+void printUsage() {
+    std::fprintf(stderr, "usage: tux_bench [--filter=SUBSTR] [--min-time=SECONDS] [--out=FILE] [--list] [--no-ui]\n");
+}
+
+} // namespace
+
+} // namespace tux_ti83::bench
+
+int main(int argc, char** argv) {
+    using namespace tux_ti83::bench;
+    std::string filter, outPath;
+    double minTime = 0.2;
+    bool list = false, ui = true;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0) filter = arg.substr(9);
+        else if (arg.rfind("--min-time=", 0) == 0) minTime = std::atof(arg.c_str() + 11);
+        else if (arg.rfind("--out=", 0) == 0) outPath = arg.substr(6);
+        else if (arg == "--list") list = true;
+        else if (arg == "--no-ui") ui = false;
+        else { printUsage(); return arg == "--help" ? 0 : 2; }
+    }
+
+    Registry registry;
+    registerCoreBenchmarks(registry);
+    if (ui) registerUiBenchmarks(registry, argc, argv);
+
+    if (list) {
+        for (const auto& c : registry.cases()) std::printf("%s\n", c.name.c_str());
+        return 0;
+    }
+
+    FILE* out = outPath.empty() ? stdout : std::fopen(outPath.c_str(), "w");
+    if (!out) { std::fprintf(stderr, "tux_bench: cannot open %s\n", outPath.c_str()); return 1; }
+
+    char date[32];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    std::fprintf(out, "{\n  \"context\": {\"date\": \"%s\", \"build_type\": \"%s\", \"compiler\": \"%s\", \"hardware_threads\": %u, \"min_time_s\": %g},\n",
+                 date, TUX_BUILD_TYPE, jsonEscape(TUX_COMPILER).c_str(), std::thread::hardware_concurrency(), minTime);
+    std::fprintf(out, "  \"benchmarks\": [");
+    bool first = true;
+    for (const auto& c : registry.cases()) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+        const Measurement m = measure(c, minTime);
+        const double ops = double(m.iterations);
+        std::fprintf(out, "%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f, "
+                          "\"items_per_second\": %.6g, \"item_unit\": \"%s\"}",
+                     first ? "" : ",", jsonEscape(c.name).c_str(), static_cast<unsigned long long>(m.iterations), m.seconds * 1e9 / ops,
+                     double(m.allocs) / ops, double(m.bytes) / ops, m.seconds > 0 ? c.itemsPerOp * ops / m.seconds : 0.0, c.itemUnit.c_str());
+        std::fflush(out);
+        first = false;
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) std::fclose(out);
+    return 0;
+}
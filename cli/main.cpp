@@ -0,0 +1,374 @@
+#include "capsules/capsule_math.hpp"
+#include "capsules/capsule_optimizer.hpp"
+#include "capsules/capsule_profiler.hpp"
+#include "capsules/capsule_sampler.hpp"
+#include "capsules/capsule_tokenizer.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace tux_ti83;
+
+namespace {
+
+constexpr size_t kFormatChunk = 4096; // Rows formatted per parallel task
+
+struct Options {
+    std::vector<std::string> expressions; // Y1, Y2, ... for table mode
+    bool hasRange = false;
+    double rangeStart = 0, rangeStop = 0, rangeStep = 1;
+    double x = 0;                          // X for expression mode
+    size_t batch = 65536;                  // Rows held in memory at once
+    unsigned threads = 0;
+    int precision = 0;                     // 0 = shortest round-trip
+    bool header = true;
+    bool optimize = true;
+    bool explain = false;                  // Print each -e program to stderr
+    bool profile = false;                  // Stage totals to stderr on exit
+    std::string tracePath;                 // Chrome trace-event JSON written on exit
+    std::string inputPath, outputPath;
+};
+
+void printUsage(FILE* to) {
+    std::fprintf(to,
+        "usage: tux_ti83_cli [options] [FILE]\n"
+        "\n"
+        "Expression mode (no -e): each input line is an expression, evaluated at X (--x).\n"
+        "Table mode (-e given):   writes X,Y1,Y2,... for every X from --range, or one X per input line.\n"
+        "\n"
+        "  -e, --expr EXPR        add a function of X, e.g. \"sin(X)^2+[A]*3\" (repeatable)\n"
+        "      --range A:B:STEP   generate X = A, A+STEP, ... up to B instead of reading input\n"
+        "      --x VALUE          X used in expression mode (default 0)\n"
+        "      --matrix N=ROWS    define [N], rows separated by ';', e.g. --matrix \"A=1,2;3,4\"\n"
+        "      --list Ln=VALUES   define L1..L6 from comma-separated values, or from a file of numbers\n"
+        "                         separated by commas or whitespace with Ln=@FILE\n"
+        "      --batch ROWS       rows evaluated per parallel batch (default 65536)\n"
+        "      --threads N        worker threads, 0 = all cores (default)\n"
+        "      --precision DIGITS significant digits (default: shortest exact form)\n"
+        "      --no-header        omit the CSV header in table mode\n"
+        "      --explain          print the RPN and bytecode of each -e to stderr\n"
+        "      --no-optimize      skip constant folding and subexpression reuse\n"
+        "      --profile          print time per stage and counters to stderr on exit\n"
+        "      --trace FILE       record every stage as a Chrome trace event (chrome://tracing, Perfetto)\n"
+        "  -o, --out FILE         write to FILE instead of stdout\n"
+        "FILE defaults to stdin ('-').\n");
+}
+
+bool parseDouble(std::string_view text, double& out) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) text.remove_suffix(1);
+    if (!text.empty() && text.front() == '+') text.remove_prefix(1);
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc() && end == text.data() + text.size() && !text.empty();
+}
+
+bool parseRange(std::string_view text, Options& opts) {
+    size_t a = text.find(':'), b = text.find(':', a == std::string_view::npos ? a : a + 1);
+    if (a == std::string_view::npos || b == std::string_view::npos) return false;
+    if (!parseDouble(text.substr(0, a), opts.rangeStart) || !parseDouble(text.substr(a + 1, b - a - 1), opts.rangeStop) ||
+        !parseDouble(text.substr(b + 1), opts.rangeStep))
+        return false;
+    const double span = opts.rangeStop - opts.rangeStart;
+    opts.hasRange = true;
+    return opts.rangeStep != 0 && std::isfinite(span / opts.rangeStep) && span / opts.rangeStep >= 0;
+}
+
+// "A=1,2;3,4" -> 2x2 [A] in the shared registry
+bool parseMatrix(std::string_view text, std::string& error) {
+    if (text.size() < 3 || text[1] != '=' || text[0] < 'A' || text[0] > 'J') { error = "expected NAME=ROWS with NAME in A..J"; return false; }
+    const Token name = static_cast<Token>(static_cast<int>(Token::MatA) + (text[0] - 'A'));
+    std::vector<double> values;
+    int rows = 0, cols = -1;
+    std::string_view body = text.substr(2);
+    while (!body.empty() || rows == 0) {
+        const size_t semi = body.find(';');
+        std::string_view row = body.substr(0, semi);
+        body = semi == std::string_view::npos ? std::string_view{} : body.substr(semi + 1);
+        int count = 0;
+        for (;;) {
+            const size_t comma = row.find(',');
+            double v;
+            if (!parseDouble(row.substr(0, comma), v)) { error = "bad number in row " + std::to_string(rows + 1); return false; }
+            values.push_back(v); ++count;
+            if (comma == std::string_view::npos) break;
+            row = row.substr(comma + 1);
+        }
+        if (cols >= 0 && count != cols) { error = "rows have different lengths"; return false; }
+        cols = count; ++rows;
+    }
+    MathStateMachine::setMatrix(name, Matrix(rows, cols, std::move(values)));
+    return true;
+}
+
+// "L1=1,2,3" or "L1=@readings.txt" -> L1 in the shared registry
+bool parseList(std::string_view text, std::string& error) {
+    if (text.size() < 3 || (text[0] != 'L' && text[0] != 'l') || text[1] < '1' || text[1] > '6' || text[2] != '=') {
+        error = "expected Ln=VALUES with n in 1..6";
+        return false;
+    }
+    const Token name = static_cast<Token>(static_cast<int>(Token::List1) + (text[1] - '1'));
+    std::string contents;
+    std::string_view body = text.substr(3);
+    if (!body.empty() && body.front() == '@') {
+        std::ifstream file{std::string(body.substr(1)), std::ios::binary};
+        if (!file) { error = "cannot open " + std::string(body.substr(1)); return false; }
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        body = contents;
+    }
+    std::vector<double> values;
+    const char* p = body.data();
+    const char* end = p + body.size();
+    auto separator = [](char c) { return c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+    for (;;) {
+        while (p < end && separator(*p)) ++p;
+        if (p == end) break;
+        if (*p == '+') ++p;
+        double v;
+        auto [next, ec] = std::from_chars(p, end, v);
+        if (ec != std::errc() || (next < end && !separator(*next))) { error = "bad number after element " + std::to_string(values.size()); return false; }
+        values.push_back(v);
+        p = next;
+    }
+    MathStateMachine::setList(name, List(std::move(values)));
+    return true;
+}
+
+void appendNumber(std::string& out, double v, int precision) {
+    char buf[64];
+    auto r = precision > 0 ? std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::general, precision)
+                           : std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+// Same rendering as the calculator's history: scalars plain, matrices as [[a,b][c,d]], lists as {a,b,c}
+void appendResult(std::string& out, const CalculationResult& result, int precision) {
+    if (!result.success) { out += "ERR: "; out += result.error_message; return; }
+    if (result.isList) {
+        out += '{';
+        for (size_t i = 0; i < result.listValue.size(); ++i) {
+            if (i) out += ',';
+            appendNumber(out, result.listValue.data()[i], precision);
+        }
+        out += '}';
+        return;
+    }
+    if (!result.isMatrix) { appendNumber(out, result.value, precision); return; }
+    const Matrix& m = result.matrixValue;
+    out += "[[";
+    for (int i = 0; i < m.rows; ++i) {
+        for (int j = 0; j < m.cols; ++j) {
+            appendNumber(out, m.at(i, j), precision);
+            if (j < m.cols - 1) out += ',';
+        }
+        if (i < m.rows - 1) out += "][";
+    }
+    out += "]]";
+}
+
+class Writer {
+public:
+    explicit Writer(FILE* file) : m_file(file) {}
+    bool write(const std::string& s) { return s.empty() || std::fwrite(s.data(), 1, s.size(), m_file) == s.size(); }
+
+private:
+    FILE* m_file;
+};
+
+// Formats rows [0, count) as count/kFormatChunk parallel tasks, then writes the chunks in order
+template <class FormatRow>
+bool emitRows(ParallelSampler& sampler, Writer& writer, std::vector<std::string>& chunks, size_t count, FormatRow&& formatRow) {
+    const size_t tasks = (count + kFormatChunk - 1) / kFormatChunk;
+    if (chunks.size() < tasks) chunks.resize(tasks);
+    sampler.parallelFor(tasks, [&](size_t t) {
+        std::string& out = chunks[t];
+        out.clear();
+        for (size_t i = t * kFormatChunk; i < std::min(count, (t + 1) * kFormatChunk); ++i) formatRow(out, i);
+    });
+    for (size_t t = 0; t < tasks; ++t)
+        if (!writer.write(chunks[t])) return false;
+    return true;
+}
+
+int runTable(const Options& opts, std::istream& in, Writer& writer, ParallelSampler& sampler) {
+    std::vector<CompiledExpression> functions;
+    for (size_t f = 0; f < opts.expressions.size(); ++f) {
+        TokenizeResult tokens = tokenize(opts.expressions[f]);
+        if (!tokens.success) {
+            std::fprintf(stderr, "tux_ti83_cli: Y%zu: %s at column %zu\n", f + 1, tokens.error_message.c_str(), tokens.errorOffset + 1);
+            return 1;
+        }
+        functions.emplace_back(tokens.tokens, opts.optimize);
+        if (opts.explain) {
+            const CompiledExpression& fn = functions.back();
+            std::fprintf(stderr, "Y%zu: %s\n%s", f + 1, disassemble(fn.program()).c_str(), disassemble(fn.bytecode()).c_str());
+        }
+        CalculationResult probe = functions.back().evaluate(opts.hasRange ? opts.rangeStart : 0.0);
+        if (!probe.success || probe.isMatrix || probe.isList) {
+            std::fprintf(stderr, "tux_ti83_cli: Y%zu: %s\n", f + 1, !probe.success ? probe.error_message.c_str() :
+                         probe.isMatrix ? "matrix result; table mode needs scalars" : "list result; table mode needs scalars");
+            return 1;
+        }
+    }
+    std::vector<const CompiledExpression*> pointers;
+    for (const auto& f : functions) pointers.push_back(&f);
+
+    if (opts.header) {
+        std::string header = "X";
+        for (size_t f = 0; f < functions.size(); ++f) header += ",Y" + std::to_string(f + 1);
+        writer.write(header + "\n");
+    }
+
+    std::vector<double> xs;
+    xs.reserve(opts.batch);
+    std::vector<std::string> chunks;
+    auto flush = [&]() {
+        if (xs.empty()) return true;
+        std::vector<SampleSeries> series = sampler.sample(pointers, xs);
+        bool ok = emitRows(sampler, writer, chunks, xs.size(), [&](std::string& out, size_t i) {
+            appendNumber(out, xs[i], opts.precision);
+            for (const auto& s : series) { out += ','; appendNumber(out, s.ys[i], opts.precision); }
+            out += '\n';
+        });
+        xs.clear();
+        return ok;
+    };
+
+    if (opts.hasRange) {
+        // Index-based so millions of steps do not accumulate rounding drift
+        const double steps = std::floor((opts.rangeStop - opts.rangeStart) / opts.rangeStep + 1e-9);
+        for (double i = 0; i <= steps; ++i) {
+            xs.push_back(opts.rangeStart + i * opts.rangeStep);
+            if (xs.size() == opts.batch && !flush()) return 1;
+        }
+    } else {
+        std::string line;
+        size_t lineNo = 0;
+        while (std::getline(in, line)) {
+            ++lineNo;
+            if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#') continue;
+            double x;
+            if (!parseDouble(line, x)) {
+                std::fprintf(stderr, "tux_ti83_cli: line %zu: not a number\n", lineNo);
+                return 1;
+            }
+            xs.push_back(x);
+            if (xs.size() == opts.batch && !flush()) return 1;
+        }
+    }
+    return flush() ? 0 : 1;
+}
+
+int runExpressions(const Options& opts, std::istream& in, Writer& writer, ParallelSampler& sampler) {
+    std::vector<std::string> lines;
+    lines.reserve(opts.batch);
+    std::vector<std::string> chunks;
+    auto flush = [&]() {
+        bool ok = emitRows(sampler, writer, chunks, lines.size(), [&](std::string& out, size_t i) {
+            TokenizeResult tokens = tokenize(lines[i]);
+            if (!tokens.success) {
+                out += "ERR: " + tokens.error_message + " at column " + std::to_string(tokens.errorOffset + 1);
+            } else {
+                appendResult(out, CompiledExpression(tokens.tokens, opts.optimize).evaluate(opts.x), opts.precision);
+            }
+            out += '\n';
+        });
+        lines.clear();
+        return ok;
+    };
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        lines.push_back(std::move(line));
+        if (lines.size() == opts.batch && !flush()) return 1;
+    }
+    return flush() ? 0 : 1;
+}
+
+void printProfile(const profile::Snapshot& start, const profile::Snapshot& end) {
+    std::fprintf(stderr, "wall %.3f ms\n", double(end.timeNs - start.timeNs) / 1e6);
+    for (size_t i = 0; i < profile::kStageCount; ++i) {
+        const uint64_t calls = end.stageCalls[i] - start.stageCalls[i];
+        if (!calls) continue;
+        const double ms = double(end.stageNs[i] - start.stageNs[i]) / 1e6;
+        std::fprintf(stderr, "%-12s %10.3f ms %10llu calls %10.3f us/call\n", profile::stageName(static_cast<profile::Stage>(i)), ms,
+                     static_cast<unsigned long long>(calls), ms * 1e3 / double(calls));
+    }
+    for (size_t i = 0; i < profile::kCounterCount; ++i) {
+        const uint64_t n = end.counters[i] - start.counters[i];
+        if (n) std::fprintf(stderr, "%-12s %10llu\n", profile::counterName(static_cast<profile::Counter>(i)), static_cast<unsigned long long>(n));
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::ios::sync_with_stdio(false);
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        auto value = [&](const char* what) -> const char* {
+            if (i + 1 >= argc) { std::fprintf(stderr, "tux_ti83_cli: %s needs a value\n", what); std::exit(2); }
+            return argv[++i];
+        };
+        if (arg == "-h" || arg == "--help") { printUsage(stdout); return 0; }
+        else if (arg == "-e" || arg == "--expr") opts.expressions.push_back(value("--expr"));
+        else if (arg == "--range") {
+            if (!parseRange(value("--range"), opts)) { std::fprintf(stderr, "tux_ti83_cli: --range expects A:B:STEP stepping towards B\n"); return 2; }
+        } else if (arg == "--x") {
+            if (!parseDouble(value("--x"), opts.x)) { std::fprintf(stderr, "tux_ti83_cli: --x expects a number\n"); return 2; }
+        } else if (arg == "--matrix") {
+            std::string error;
+            if (!parseMatrix(value("--matrix"), error)) { std::fprintf(stderr, "tux_ti83_cli: --matrix: %s\n", error.c_str()); return 2; }
+        } else if (arg == "--list") {
+            std::string error;
+            if (!parseList(value("--list"), error)) { std::fprintf(stderr, "tux_ti83_cli: --list: %s\n", error.c_str()); return 2; }
+        } else if (arg == "--batch") opts.batch = std::max<long long>(1, std::atoll(value("--batch")));
+        else if (arg == "--threads") opts.threads = static_cast<unsigned>(std::max(0, std::atoi(value("--threads"))));
+        else if (arg == "--precision") opts.precision = std::max(0, std::min(17, std::atoi(value("--precision"))));
+        else if (arg == "--no-header") opts.header = false;
+        else if (arg == "--explain") opts.explain = true;
+        else if (arg == "--no-optimize") opts.optimize = false;
+        else if (arg == "--profile") opts.profile = true;
+        else if (arg == "--trace") opts.tracePath = value("--trace");
+        else if (arg == "-o" || arg == "--out") opts.outputPath = value("--out");
+        else if (arg.size() > 1 && arg[0] == '-' && arg != "-") { std::fprintf(stderr, "tux_ti83_cli: unknown option %s\n", argv[i]); printUsage(stderr); return 2; }
+        else opts.inputPath = std::string(arg);
+    }
+    if (opts.hasRange && opts.expressions.empty()) { std::fprintf(stderr, "tux_ti83_cli: --range needs at least one -e\n"); return 2; }
+    if ((opts.profile || !opts.tracePath.empty()) && !profile::kEnabled) {
+        std::fprintf(stderr, "tux_ti83_cli: --profile and --trace need a build with TUX_PROFILING=ON\n");
+        return 2;
+    }
+    if (!opts.tracePath.empty()) profile::startTrace();
+    const profile::Snapshot start = profile::snapshot();
+
+    std::ifstream file;
+    if (!opts.inputPath.empty() && opts.inputPath != "-") {
+        file.open(opts.inputPath);
+        if (!file) { std::fprintf(stderr, "tux_ti83_cli: cannot open %s\n", opts.inputPath.c_str()); return 1; }
+    }
+    std::istream& in = file.is_open() ? static_cast<std::istream&>(file) : std::cin;
+
+    FILE* out = opts.outputPath.empty() ? stdout : std::fopen(opts.outputPath.c_str(), "wb");
+    if (!out) { std::fprintf(stderr, "tux_ti83_cli: cannot open %s\n", opts.outputPath.c_str()); return 1; }
+    Writer writer(out);
+
+    ParallelSampler sampler(opts.threads);
+    const int status = opts.expressions.empty() ? runExpressions(opts, in, writer, sampler) : runTable(opts, in, writer, sampler);
+    if (std::fflush(out) != 0 && status == 0) { std::fprintf(stderr, "tux_ti83_cli: write failed\n"); return 1; }
+    if (out != stdout) std::fclose(out);
+    if (opts.profile) printProfile(start, profile::snapshot());
+    if (!opts.tracePath.empty() && !profile::writeTrace(opts.tracePath)) {
+        std::fprintf(stderr, "tux_ti83_cli: cannot write %s\n", opts.tracePath.c_str());
+        return 1;
+    }
+    return status;
+}
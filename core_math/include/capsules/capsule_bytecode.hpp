@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tux_ti83 {
+
+    enum class Token; // capsule_math.hpp
+
+    using RpnProgram = std::vector<std::pair<Token, double>>; // Num0 entries carry their literal
+
+    // Register machine code compiled from RPN. Every operand stack position owns one scalar register
+    // (S), one matrix register (M) and one list register (L); which one is live is fixed at compile time,
+    // so type and depth errors never reach evaluation. Optimizer slots sit in S0..S(slots-1), below the stack.
+    enum class OpCode : uint8_t {
+        Const, LoadX, Move,                                 // S[dst] = imm / X / S[a]
+        Sin, Cos, Tan, Log, Ln, Sqrt, ASin, ACos, ATan,     // S[dst] = f(S[a])
+        Not, Recip, ScalarInverse,                          // ScalarInverse is ⁻¹ (0 stays 0)
+        Add, Sub, Mul, Div, Pow,                            // S[dst] = S[a] op S[b]
+        Equal, NotEqual, Less, LessEq, Greater, GreaterEq, And, Or, Xor,
+        NotCompare,                                         // S[dst] = !(S[a] token S[b])
+        MatLoad,                                            // M[dst] = registry[token]
+        MatAdd, MatSub, MatMul,                             // M[dst] = M[a] op M[b]
+        MatScale,                                           // M[dst] = M[a] × S[b]
+        ScaleMat,                                           // M[dst] = S[a] × M[b]
+        MatTranspose, MatInverse,                           // M[dst] = f(M[a])
+        MatDet,                                             // S[dst] = det(M[a])
+        ListLoad,                                           // L[dst] = registry[token]
+        ListMap,                                            // L[dst] = token(L[a]) element-wise
+        ListList, ListScalar, ScalarList,                   // L[dst] = L[a]|S[a] token L[b]|S[b], broadcasting scalars
+        ListSum, ListMean, ListStdDev,                      // S[dst] = f(L[a])
+        ListSortA, ListCumSum,                              // L[dst] = f(L[a])
+        ListLinReg                                          // L[dst] = {a, b, r} fitting L[b] against L[a]
+    };
+
+    enum class ValueKind : uint8_t { Scalar, Matrix, List };
+
+    struct Instruction {
+        OpCode op;
+        Token token;    // Source token: the kernel for batch columns and lists, the registry entry for loads,
+                        // the comparison for NotCompare
+        uint16_t dst = 0, a = 0, b = 0;
+        double imm = 0; // Const only
+    };
+
+    struct Bytecode {
+        std::vector<Instruction> code;
+        int scalarRegisters = 0;
+        int matrixRegisters = 0;     // 0 for programs without matrices
+        int listRegisters = 0;       // 0 for programs without lists
+        int result = 0;              // Register holding the value left on top of the stack
+        ValueKind resultKind = ValueKind::Scalar;
+        bool usesRegistry = false;   // Reads matrices or lists: evaluation pins a registry snapshot
+        std::string error;           // "Error" (malformed) or "Type Error"; the program is not runnable
+    };
+
+    Bytecode compileBytecode(const RpnProgram& rpn, int slotCount);
+
+    // One instruction per line, e.g. "s3 = mul s3, s4", for tests and --explain
+    std::string disassemble(const Bytecode& bytecode);
+}
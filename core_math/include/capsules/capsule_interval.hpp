@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include "capsules/capsule_math.hpp"
+
+namespace tux_ti83 {
+
+    // Closed range [lo, hi] of doubles, endpoints possibly infinite, holding every value an operation can
+    // produce over its inputs' ranges. NaN results are not values: `nan` records that one may occur, which
+    // matters because comparisons, not(, √ and log turn NaN back into numbers.
+    struct Interval {
+        double lo = 0, hi = 0;
+        bool nan = false;
+
+        static Interval point(double v);
+        static Interval entire(); // [-∞, ∞] with NaN possible: nothing is known
+        bool isEntire() const;
+        bool isBounded() const;   // Both endpoints finite
+    };
+
+    // Enclosure of every non-NaN value the VM can produce for any X in x, with outward rounding. Programs that
+    // read the registry, fail to compile or do not return a scalar give Interval::entire().
+    Interval evaluateInterval(const CompiledExpression& expr, Interval x);
+
+    struct RangeOptions {
+        double relativeTolerance = 1e-2; // Of the attained range: how loose lo/hi may be around the true extremes
+        size_t maxIntervalEvaluations = 512;
+    };
+
+    // Y extremes of f over [xMin, xMax] by branch and bound: the interval enclosure of each piece is compared
+    // against values attained at piece midpoints, and only pieces that could still hold a new extreme are halved.
+    struct RangeBound {
+        bool success = false;          // At least one finite sample; sampledLo/Hi are valid
+        bool bounded = false;          // lo/hi are a finite guaranteed enclosure of every finite f(X)
+        double lo = 0, hi = 0;         // Guaranteed enclosure, tight to the tolerance when refinement converged
+        double sampledLo = 0, sampledHi = 0; // Attained extremes: an inner bound
+        size_t intervalEvaluations = 0, pointEvaluations = 0;
+    };
+    RangeBound boundRange(const CompiledExpression& expr, double xMin, double xMax, const RangeOptions& options = {});
+}
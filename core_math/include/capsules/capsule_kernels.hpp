@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include "capsules/capsule_math.hpp"
+
+namespace tux_ti83 {
+
+    // Column kernels of the batch evaluator. The optimizer folds constants through the same loops (n = 1),
+    // so a folded value is bit-identical to what evaluation would have produced.
+    bool is_batch_binary(Token t);
+    void applyUnary(Token t, double* v, size_t n);
+    void applyBinary(Token t, double* __restrict a, const double* __restrict b, size_t n);
+    void applyNotCompare(Token cmp, double* __restrict a, const double* __restrict b, size_t n); // not(a cmp b)
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <span>
+#include "capsules/capsule_bytecode.hpp"
+
+namespace tux_ti83 {
+
+    // L1..L6: one contiguous column of doubles behind copy-on-write storage, like Matrix, so registry
+    // reads and operand moves never copy the elements
+    struct List {
+        List() = default;
+        explicit List(std::vector<double> values);
+
+        size_t size() const { return m_data ? m_data->size() : 0; }
+        const double* data() const { return m_data ? m_data->data() : nullptr; }
+        std::span<const double> values() const { return {data(), size()}; }
+        double* mutableData(); // Detaches from other handles before returning
+        bool sharesStorageWith(const List& other) const { return m_data && m_data == other.m_data; }
+
+    private:
+        std::shared_ptr<std::vector<double>> m_data;
+    };
+
+    // Lists of kListParallelMin elements or more are split into kListChunk-element tasks across a shared
+    // worker pool, or run serially when called from inside a pool task, whose pool already has the cores.
+    // Reductions combine per-chunk partials in chunk order, so results never depend on the thread count.
+    constexpr size_t kListChunk = 1 << 16;
+    constexpr size_t kListParallelMin = 1 << 17;
+
+    // Element-wise kernels with the evaluator's scalar semantics (÷0 is 0, √ of a negative is 0, ...)
+    void listApply(Token t, List& l);                   // l = f(l) for a function or postfix token
+    void listApply(Token t, List& a, const List& b);    // a = a op b; caller checks the lengths match
+    void listApply(Token t, List& a, double b);         // a = a op b
+    void listApply(Token t, double a, List& b);         // b = a op b
+
+    double listSum(const List& l);
+    double listMean(const List& l);    // NaN when empty
+    double listStdDev(const List& l);  // Sample standard deviation (Sx), NaN below two elements
+    List listSortA(List l);            // Ascending, NaN last
+    List listCumSum(List l);
+
+    struct LinearFit {
+        double a = 0, b = 0, r = 0; // y = ax+b, correlation coefficient r
+        bool success = false;       // false on a length mismatch, fewer than two points or constant x
+    };
+    LinearFit linearRegression(const List& xs, const List& ys);
+}
@@ -2,6 +2,13 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <span>
+#include <memory>
+#include <cstdint>
+#include <utility>
+#include "capsules/capsule_bytecode.hpp"
+#include "capsules/capsule_list.hpp"
+#include "capsules/capsule_matrix.hpp"
 
 namespace tux_ti83 {
 
@@ -14,24 +21,31 @@ namespace tux_ti83 {
         LeftParen, RightParen, VarX,
         // Matrix Specific Tokens
         OpenBracket, CloseBracket, Comma,
-        MatA, MatB, MatC, MatD, MatE, MatF, MatG, MatH, MatI, MatJ
-    };
-
-    struct Matrix {
-        int rows = 0;
-        int cols = 0;
-        std::vector<double> data;
-        
-        double at(int r, int c) const { return data[r * cols + c]; }
-        void set(int r, int c, double val) { data[r * cols + c] = val; }
+        MatA, MatB, MatC, MatD, MatE, MatF, MatG, MatH, MatI, MatJ,
+        Det, Transpose, Inverse, // det( is a prefix function, ᵀ and ⁻¹ are postfix
+        // List Specific Tokens: sum( … cumSum( take one list, LinReg( takes two separated by Comma
+        List1, List2, List3, List4, List5, List6,
+        Sum, Mean, StdDev, SortA, CumSum, LinReg,
+        // Optimizer-only opcodes, never typed: Load/Store carry a slot index and NotCompare a comparison Token
+        Load, Store, Recip, NotCompare
     };
 
     struct CalculationResult {
-        bool success;
-        double value;
-        Matrix matrixValue; // Supports matrix-to-matrix results
+        bool success = false;
+        double value = 0.0;
+        Matrix matrixValue{}; // Supports matrix-to-matrix results
         bool isMatrix = false;
-        std::string error_message;
+        std::string error_message{};
+        List listValue{};   // LinReg( gives {a, b, r}
+        bool isList = false;
+    };
+
+    // Matrix and list registry contents at one version. Published snapshots are never modified; handles share
+    // element storage with the previous version, so an edit copies two small maps and nothing else
+    struct RegistrySnapshot {
+        uint64_t version = 0;
+        std::map<Token, Matrix> matrices;
+        std::map<Token, List> lists;
     };
 
     class EOSPrecedence {
@@ -40,14 +54,47 @@ namespace tux_ti83 {
         static bool is_left_associative(Token t);
         static bool is_operator(Token t);
         static bool is_function(Token t);
+        static bool is_postfix(Token t);
+    };
+
+    // Token graph parsed once into flat RPN and compiled to register bytecode; evaluate() may be called
+    // repeatedly for different X and allocates nothing for scalar programs
+    class CompiledExpression {
+    public:
+        CompiledExpression() = default;
+        explicit CompiledExpression(const std::vector<Token>& graph, bool optimize = true);
+
+        CalculationResult evaluate(double xValue = 0.0) const;
+        CalculationResult evaluate(double xValue, const RegistrySnapshot& registry) const; // Against a pinned snapshot
+        // Column-wise evaluation over xs, pinning one registry snapshot for the whole batch; false (ys filled
+        // with NaN) when the program has no scalar result
+        bool evaluateBatch(std::span<const double> xs, std::span<double> ys) const;
+        bool evaluateBatch(std::span<const double> xs, std::span<double> ys, const RegistrySnapshot& registry) const;
+
+        // The RPN after optimizeProgram() (when enabled) and the bytecode evaluate() runs; see disassemble()
+        const RpnProgram& program() const { return m_rpn; }
+        const Bytecode& bytecode() const { return m_code; }
+
+    private:
+        CalculationResult evaluatePinned(double xValue, const RegistrySnapshot* registry) const; // registry may be null when !m_code.usesRegistry
+        bool evaluateBatchPinned(std::span<const double> xs, std::span<double> ys, const RegistrySnapshot* registry) const;
+
+        RpnProgram m_rpn;
+        Bytecode m_code;
+        std::string m_error; // Parse or compile error, returned by every evaluation
     };
 
     class MathStateMachine {
     public:
         CalculationResult evaluate(const std::vector<Token>& graph, double xValue = 0.0);
+        bool evaluateBatch(const std::vector<Token>& graph, std::span<const double> xs, std::span<double> ys);
         static std::string toFraction(double value, double tolerance = 1.0e-9);
         
-        // Matrix Storage
-        static std::map<Token, Matrix> matrixRegistry;
+        // Matrix and list storage, read-copy-update: registry() pins the current snapshot with one atomic load and
+        // never waits for a writer; setMatrix()/setList() publish a copy with the next version and return it
+        static std::shared_ptr<const RegistrySnapshot> registry();
+        static uint64_t registryVersion() { return registry()->version; }
+        static uint64_t setMatrix(Token name, Matrix value);
+        static uint64_t setList(Token name, List value);
     };
 }
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <span>
+
+namespace tux_ti83 {
+
+    // Value handle over reference-counted storage: copying a Matrix shares its elements, and the first
+    // write through a shared handle clones them (copy-on-write), so registry reads and operand moves are free
+    struct Matrix {
+        int rows = 0;
+        int cols = 0;
+
+        Matrix() = default;
+        Matrix(int r, int c, std::vector<double> values = {}); // values are zero-padded or truncated to r*c
+
+        double at(int r, int c) const { return (*m_data)[r * cols + c]; }
+        void set(int r, int c, double val) { mutableData()[r * cols + c] = val; }
+        size_t size() const { return static_cast<size_t>(rows) * cols; }
+        const double* data() const { return m_data ? m_data->data() : nullptr; }
+        double* mutableData(); // Detaches from other handles before returning
+        bool sharesStorageWith(const Matrix& other) const { return m_data && m_data == other.m_data; }
+        bool isShared() const { return m_data.use_count() > 1; }
+
+    private:
+        std::shared_ptr<std::vector<double>> m_data;
+    };
+
+    struct MatrixTerm {
+        double coeff;
+        Matrix mat;
+    };
+
+    // Kernels return an empty (0x0) Matrix on a dimension mismatch
+    Matrix matrixCombine(std::span<const MatrixTerm> terms); // sum(coeff * mat) in one pass, one output allocation
+    Matrix matrixAdd(const Matrix& a, const Matrix& b);
+    Matrix matrixMul(const Matrix& a, const Matrix& b);            // Cache-blocked, unit-stride inner loop
+    Matrix matrixScale(const Matrix& a, double s);
+    Matrix matrixAxpby(double alpha, const Matrix& a, double beta, const Matrix& b); // alpha*a + beta*b in one pass
+    void matrixTranspose(Matrix& m); // Swaps in place when square and unshared, else a blocked copy into new storage
+
+    // Row-major LU with scaled partial pivoting: rows of `lu` are already permuted, L has an implicit unit diagonal
+    struct LUDecomposition {
+        Matrix lu;
+        std::vector<int> pivots; // pivots[k] = original row now at row k
+        int sign = 1;            // Parity of the row permutation
+        bool singular = false;
+    };
+
+    LUDecomposition luDecompose(Matrix m);
+    double matrixDeterminant(const Matrix& m);
+    bool matrixInverse(const Matrix& m, Matrix& inverse); // false when singular or not square
+}
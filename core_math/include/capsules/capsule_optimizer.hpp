@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include "capsules/capsule_math.hpp"
+
+namespace tux_ti83 {
+
+    struct OptimizedProgram {
+        RpnProgram rpn;
+        int slotCount = 0;    // Load/Store slots the program needs
+        bool changed = false; // false: rpn is the input, unmodified
+    };
+
+    // Rebuilds well-formed RPN as a DAG and emits it back with
+    //  - constant folding of every subtree free of X, matrices and lists,
+    //  - common subexpressions computed once (Store) and reused (Load),
+    //  - X^0..4, X^-1, X^-2 as multiplies/Recip, ÷c as ×(1/c) for powers of two c, not(a<b) as one NotCompare.
+    // The power rewrites round after each multiply, so X^3, X^4 and X^-2 can differ from pow() by a few ULPs.
+    // Matrix and list subtrees are never folded or shared: the registry can change between evaluations.
+    // Programs with tokens outside the evaluator's scalar/matrix set are returned unchanged.
+    OptimizedProgram optimizeProgram(const RpnProgram& rpn);
+
+    // One line per program, e.g. "x store0 load0 mul 0.7071067811865476 mul", for tests and --explain
+    std::string disassemble(const RpnProgram& rpn);
+}
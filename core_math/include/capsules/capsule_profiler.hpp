@@ -0,0 +1,100 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// CMake's TUX_PROFILING option sets TUX_PROFILE=1 on core_math and everything linking it. At 0 the
+// TUX_PROFILE_* macros expand to nothing, so the hot paths carry no clock reads, counters or branches.
+#ifndef TUX_PROFILE
+#define TUX_PROFILE 0
+#endif
+
+namespace tux_ti83::profile {
+
+    constexpr bool kEnabled = TUX_PROFILE != 0;
+
+    enum class Stage : uint8_t {
+        Parse,    // Token buffer to runnable bytecode (CompiledExpression construction)
+        Evaluate, // evaluateBatch calls, nested inside Sample when graphing
+        Sample,   // ParallelSampler uniform, adaptive and cached passes
+        Box,      // Packing samples into QVariantMaps for QML (getMultiGraphPoints)
+        Layout,   // Curves and grid to pixel-space vertex data (GraphPlotItem::updatePolish)
+        Paint,    // Vertex data into scene-graph nodes or QPainter strokes
+        Count
+    };
+
+    enum class Counter : uint8_t {
+        Evaluations, // Samples computed through evaluateBatch
+        Allocations, // operator new calls, when the executable replaces it (app/main.cpp)
+        CacheHits,   // SampleCache tiles reused by sampleCached
+        CacheMisses, // SampleCache tiles sampled afresh
+        Frames,      // Plot frames handed to the scene graph
+        Count
+    };
+
+    constexpr size_t kStageCount = static_cast<size_t>(Stage::Count);
+    constexpr size_t kCounterCount = static_cast<size_t>(Counter::Count);
+
+    const char* stageName(Stage stage);
+    const char* counterName(Counter counter);
+
+    // Running totals since startup; callers diff two snapshots for per-interval or per-frame figures.
+    // All zeros when profiling is compiled out.
+    struct Snapshot {
+        uint64_t timeNs = 0; // Monotonic clock when taken
+        std::array<uint64_t, kStageCount> stageNs{}, stageCalls{};
+        std::array<uint64_t, kCounterCount> counters{};
+    };
+    Snapshot snapshot();
+
+    // Chrome trace-event capture (chrome://tracing, Perfetto). Every completed stage scope is recorded as
+    // one "X" event while capture is on, up to maxEvents; writeTrace() emits the JSON and keeps the buffer.
+    // All three are no-ops returning false when profiling is compiled out.
+    bool startTrace(size_t maxEvents = size_t(1) << 20);
+    bool stopTrace();
+    bool tracing();
+    bool writeTrace(const std::string& path);
+
+#if TUX_PROFILE
+    namespace detail {
+        // One cache line per total so threads bumping different stages never share a line
+        struct alignas(64) Slot { std::atomic<uint64_t> value{0}; };
+        extern Slot stageNs[kStageCount], stageCalls[kStageCount], counters[kCounterCount];
+        extern std::atomic<bool> traceOn;
+        uint64_t nowNs();
+        void recordEvent(Stage stage, uint64_t beginNs, uint64_t endNs);
+    }
+
+    inline void count(Counter counter, uint64_t n = 1) {
+        detail::counters[static_cast<size_t>(counter)].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    class ScopedStage {
+    public:
+        explicit ScopedStage(Stage stage) : m_stage(stage), m_begin(detail::nowNs()) {}
+        ~ScopedStage() {
+            const uint64_t end = detail::nowNs();
+            const size_t s = static_cast<size_t>(m_stage);
+            detail::stageNs[s].value.fetch_add(end - m_begin, std::memory_order_relaxed);
+            detail::stageCalls[s].value.fetch_add(1, std::memory_order_relaxed);
+            if (detail::traceOn.load(std::memory_order_relaxed)) detail::recordEvent(m_stage, m_begin, end);
+        }
+        ScopedStage(const ScopedStage&) = delete;
+        ScopedStage& operator=(const ScopedStage&) = delete;
+
+    private:
+        Stage m_stage;
+        uint64_t m_begin;
+    };
+
+#define TUX_PROFILE_CONCAT_(a, b) a##b
+#define TUX_PROFILE_CONCAT(a, b) TUX_PROFILE_CONCAT_(a, b)
+#define TUX_PROFILE_STAGE(stage) ::tux_ti83::profile::ScopedStage TUX_PROFILE_CONCAT(tuxProfileStage_, __LINE__)(::tux_ti83::profile::Stage::stage)
+#define TUX_PROFILE_COUNT(counter, n) ::tux_ti83::profile::count(::tux_ti83::profile::Counter::counter, (n))
+#else
+#define TUX_PROFILE_STAGE(stage) ((void)0)
+#define TUX_PROFILE_COUNT(counter, n) ((void)0)
+#endif
+}
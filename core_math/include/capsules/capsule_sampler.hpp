@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <stop_token>
+#include "capsules/capsule_math.hpp"
+
+namespace tux_ti83 {
+
+    struct Viewport {
+        double xMin, xMax, yMin, yMax;
+    };
+
+    struct SampleSeries {
+        std::vector<double> ys;
+        bool success = false;
+    };
+
+    // Non-uniform samples in X order; a NaN y marks a segment break (discontinuity or non-finite gap)
+    struct AdaptiveCurve {
+        std::vector<double> xs, ys;
+        bool success = false;
+        bool cancelled = false; // Stopped part-way; samples are incomplete
+        size_t evaluations = 0;
+        size_t intervalEvaluations = 0; // Spike guard and domain-edge checks, at most 3 per coarse segment
+    };
+
+    struct AdaptiveOptions {
+        double pixelTolerance = 0.5;   // Max screen distance between a midpoint and its chord
+        double initialSpacingPx = 8.0; // Coarse pass spacing before refinement
+        int maxDepth = 6;              // Bisections per coarse segment (8px / 2^6 = 1/8px)
+        bool intervalGuard = true;     // Interval enclosures (capsule_interval.hpp) find spikes between samples and prune off-screen work
+    };
+
+    // Starts from a coarse uniform pass and bisects, one batch per level, wherever the curve bends by more
+    // than the pixel tolerance; segments still jumping at full depth are emitted as breaks. Every sample reads
+    // registry, or the snapshot current at the call when it is null
+    AdaptiveCurve sampleAdaptive(const CompiledExpression& expr, const Viewport& vp, double widthPx, double heightPx,
+                                 const AdaptiveOptions& options = {}, std::stop_token stop = {}, const RegistrySnapshot* registry = nullptr);
+
+    // Adaptive samples of one function cut into fixed-width X tiles per power-of-two pixel scale, so a pan
+    // only samples the newly exposed tiles and a zoom-out can stitch the finer tiles it already has
+    class SampleCache {
+    public:
+        static constexpr double kTilePx = 256.0;
+        static constexpr size_t kMaxTiles = 256;
+
+        // A tile is usable when cached at these levels, or as two finer children, with a cull band covering [visMin, visMax]
+        bool hasTile(int xLevel, int yLevel, int64_t index, double visMin, double visMax);
+        bool appendTile(int xLevel, int yLevel, int64_t index, double visMin, double visMax, AdaptiveCurve& out);
+        void storeTile(int xLevel, int yLevel, int64_t index, double cullMin, double cullMax, AdaptiveCurve curve);
+        void clear() { m_tiles.clear(); }
+        size_t size() const { return m_tiles.size(); }
+
+    private:
+        struct Tile {
+            AdaptiveCurve curve;
+            double cullMin, cullMax; // Y band the tile was refined against
+            uint64_t lastUse;
+        };
+        const Tile* usable(int xLevel, int yLevel, int64_t index, double visMin, double visMax);
+        bool resolve(int xLevel, int yLevel, int64_t index, double visMin, double visMax, const Tile* (&tiles)[2]);
+
+        std::map<std::tuple<int, int, int64_t>, Tile> m_tiles;
+        uint64_t m_clock = 0;
+    };
+
+    // Persistent worker pool that splits X ranges and functions into chunks pulled from a shared counter.
+    // A thread count of 1 runs every chunk inline, in order, on the calling thread.
+    class ParallelSampler {
+    public:
+        explicit ParallelSampler(unsigned threadCount = 0); // 0 = one thread per hardware core
+        ~ParallelSampler();
+        ParallelSampler(const ParallelSampler&) = delete;
+        ParallelSampler& operator=(const ParallelSampler&) = delete;
+
+        void setThreadCount(unsigned threadCount);
+        unsigned threadCount() const { return static_cast<unsigned>(m_workers.size()) + 1; }
+
+        // Runs task(0..taskCount-1) across the pool; returns once every task has finished. Called from inside a
+        // task of any pool, it runs every task inline instead, so nested loops never queue behind the outer one
+        void parallelFor(size_t taskCount, const std::function<void(size_t)>& task);
+        static bool inTask(); // True while this thread is running a parallelFor task
+
+        // Each call evaluates every function against one registry snapshot: registry, or the current one
+        // pinned at the call when it is null, so no curve mixes matrix or list versions across chunks or tiles
+
+        // One series per function, each the same length as xs and merged in X order
+        std::vector<SampleSeries> sample(const std::vector<const CompiledExpression*>& functions, std::span<const double> xs,
+                                         const RegistrySnapshot* registry = nullptr);
+        // sampleAdaptive for each function, one function per task
+        std::vector<AdaptiveCurve> sampleAdaptive(const std::vector<const CompiledExpression*>& functions, const Viewport& vp,
+                                                  double widthPx, double heightPx, const AdaptiveOptions& options = {}, std::stop_token stop = {},
+                                                  const RegistrySnapshot* registry = nullptr);
+        // As sampleAdaptive, but served from caches[f] where possible; only missing tiles are evaluated.
+        // Tiles finished before a stop request are still cached, so cancelled passes are not wasted. The caller
+        // keys caches on the registry version of functions that read it
+        std::vector<AdaptiveCurve> sampleCached(const std::vector<const CompiledExpression*>& functions, const std::vector<SampleCache*>& caches,
+                                                const Viewport& vp, double widthPx, double heightPx, const AdaptiveOptions& options = {},
+                                                std::stop_token stop = {}, const RegistrySnapshot* registry = nullptr);
+
+        static constexpr size_t kMinChunk = 512;
+
+    private:
+        void startWorkers(unsigned threadCount);
+        void stopWorkers();
+        void workerLoop(uint64_t seen);
+        void drain();
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_callMutex; // Serialises parallelFor callers
+        std::mutex m_mutex;
+        std::condition_variable m_wake, m_done;
+        const std::function<void(size_t)>* m_task = nullptr;
+        size_t m_taskCount = 0;
+        std::atomic<size_t> m_next{0};
+        size_t m_active = 0;
+        uint64_t m_generation = 0;
+        bool m_stop = false;
+    };
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <cstdint>
+#include "capsules/capsule_math.hpp"
+
+namespace tux_ti83 {
+
+    // Newest-first history of fixed capacity. Entries live in one byte arena sized at construction, so the
+    // footprint never grows however long the session runs; longer entries are cut (at a UTF-8 boundary) with "…".
+    class HistoryRing {
+    public:
+        static constexpr size_t kMaxEntryBytes = 256;
+        static constexpr size_t kDefaultCapacity = 64;
+
+        HistoryRing() : HistoryRing(kDefaultCapacity) {}
+        explicit HistoryRing(size_t capacity);
+
+        void push(std::string_view entry); // Overwrites the oldest entry once full
+        void clear() { m_size = 0; }
+        size_t size() const { return m_size; }
+        size_t capacity() const { return m_lengths.size(); }
+        std::string_view operator[](size_t i) const; // 0 = newest
+
+    private:
+        std::vector<char> m_bytes; // capacity() slots of kMaxEntryBytes
+        std::vector<uint16_t> m_lengths;
+        size_t m_next = 0, m_size = 0;
+    };
+
+    // Everything a tux_ti83 launch restores
+    struct SessionState {
+        std::vector<std::vector<Token>> functions; // Y buffers by slot
+        std::vector<std::string> displays;         // Display string of each slot
+        std::map<Token, Matrix> matrices;
+        std::map<Token, List> lists;
+        HistoryRing history;
+    };
+
+    // Append-only binary session log. Every save*() appends one record (a 12-byte header, then the payload)
+    // with a single write, so an interrupted write can only tear the last record, which open() drops.
+    // open() maps the file and walks record headers only, copying the latest payload per slot/name and the
+    // last history().capacity() entries; superseded records are never read. Once the log holds more than
+    // kCompactRatio times its live bytes it is rewritten from the current state, which bounds both the file
+    // and the header walk by the live state rather than by how long the session has been running.
+    class SessionLog {
+    public:
+        static constexpr size_t kCompactRatio = 4;
+        static constexpr size_t kCompactMinBytes = 1 << 16;
+
+        SessionLog() = default;
+        ~SessionLog();
+        SessionLog(const SessionLog&) = delete;
+        SessionLog& operator=(const SessionLog&) = delete;
+
+        // Creates the file when missing; a file of another format or format version is an error and left untouched
+        bool open(const std::string& path, std::string& error);
+        void close();
+        bool isOpen() const { return m_fd >= 0; }
+        const SessionState& state() const { return m_state; }
+        uint64_t logBytes() const { return m_logBytes; }
+
+        // false once the log cannot be written, when state() still reflects the edit; also false, with state()
+        // unchanged, for optimizer-only tokens and for names other than [A]…[J] and L1…L6
+        bool saveFunction(size_t slot, const std::vector<Token>& tokens, const std::string& display);
+        bool saveMatrix(Token name, const Matrix& value);
+        bool saveList(Token name, const List& value);
+        bool saveHistory(std::string_view entry);
+        bool compact();
+
+    private:
+        bool commit(uint64_t written); // Accounts for one appended record, or cuts a failed one off the log
+        void maybeCompact();
+        uint64_t liveBytes() const;
+
+        std::string m_path;
+        int m_fd = -1;
+        uint64_t m_logBytes = 0;
+        SessionState m_state;
+    };
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "capsules/capsule_math.hpp"
+
+namespace tux_ti83 {
+
+    struct TokenizeResult {
+        bool success = false;
+        std::vector<Token> tokens;
+        std::string error_message;
+        size_t errorOffset = 0; // Byte offset into the input when !success
+    };
+
+    // Text front end producing the same Token stream the keypad builds, e.g. "sin(X)^2+[A]*3".
+    // Accepts ASCII and calculator spellings (* ×, / ÷, - −, <= ≤, sqrt √, pi π, ' ᵀ, ⁻¹, ²), lists L1..L6 with
+    // sum( mean( stdDev( sortA( cumSum( and LinReg(Xlist,Ylist), inserts implicit multiplication
+    // ("2X", "3(X+1)"), closes trailing parentheses and rewrites unary minus as (0−…) binding tighter
+    // than × but looser than ^, as on the TI-83.
+    TokenizeResult tokenize(std::string_view text);
+}
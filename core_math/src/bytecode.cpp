@@ -0,0 +1,240 @@
+#include "capsules/capsule_bytecode.hpp"
+#include "capsules/capsule_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <optional>
+
+namespace tux_ti83 {
+
+namespace {
+
+bool isMatrixToken(Token t) { return t >= Token::MatA && t <= Token::MatJ; }
+bool isListToken(Token t) { return t >= Token::List1 && t <= Token::List6; }
+
+// Scalar opcode of a unary function or postfix token; nullopt for tokens with no scalar meaning
+std::optional<OpCode> scalarUnary(Token t) {
+    switch (t) {
+        case Token::Sin: return OpCode::Sin;
+        case Token::Cos: return OpCode::Cos;
+        case Token::Tan: return OpCode::Tan;
+        case Token::Log: return OpCode::Log;
+        case Token::Ln: return OpCode::Ln;
+        case Token::Sqrt: return OpCode::Sqrt;
+        case Token::ASin: return OpCode::ASin;
+        case Token::ACos: return OpCode::ACos;
+        case Token::ATan: return OpCode::ATan;
+        case Token::Not: return OpCode::Not;
+        case Token::Recip: return OpCode::Recip;
+        case Token::Inverse: return OpCode::ScalarInverse;
+        default: return std::nullopt;
+    }
+}
+
+OpCode scalarBinary(Token t) {
+    switch (t) {
+        case Token::Add: return OpCode::Add;
+        case Token::Sub: return OpCode::Sub;
+        case Token::Mul: return OpCode::Mul;
+        case Token::Div: return OpCode::Div;
+        case Token::Pow: return OpCode::Pow;
+        case Token::Equal: return OpCode::Equal;
+        case Token::NotEqual: return OpCode::NotEqual;
+        case Token::Less: return OpCode::Less;
+        case Token::LessEq: return OpCode::LessEq;
+        case Token::Greater: return OpCode::Greater;
+        case Token::GreaterEq: return OpCode::GreaterEq;
+        case Token::And: return OpCode::And;
+        case Token::Or: return OpCode::Or;
+        case Token::Xor: return OpCode::Xor;
+        default: return OpCode::NotCompare;
+    }
+}
+
+OpCode listReduction(Token t) {
+    switch (t) {
+        case Token::Sum: return OpCode::ListSum;
+        case Token::Mean: return OpCode::ListMean;
+        case Token::StdDev: return OpCode::ListStdDev;
+        case Token::SortA: return OpCode::ListSortA;
+        default: return OpCode::ListCumSum;
+    }
+}
+
+// Walks the RPN with a stack of operand kinds in place of values
+class Compiler {
+public:
+    Compiler(const RpnProgram& rpn, int slotCount) : m_slots(slotCount) {
+        for (const auto& [t, value] : rpn)
+            if (!step(t, value)) return;
+        if (m_kinds.empty()) { fail("Error"); return; }
+        m_out.resultKind = m_kinds.back();
+        m_out.result = m_out.resultKind == ValueKind::Scalar ? scalar(top()) : top();
+        m_out.scalarRegisters = m_slots + m_peak;
+        m_out.matrixRegisters = m_hasMatrices ? m_peak : 0;
+        m_out.listRegisters = m_hasLists ? m_peak : 0;
+        m_out.usesRegistry = m_hasMatrices || m_hasLists;
+    }
+
+    Bytecode take() { return std::move(m_out); }
+
+private:
+    bool step(Token t, double value) {
+        const int p = static_cast<int>(m_kinds.size());
+        if (t == Token::Num0 || t == Token::Pi || t == Token::E) {
+            const double c = t == Token::Num0 ? value : (t == Token::Pi ? M_PI : M_E);
+            return push(ValueKind::Scalar, {OpCode::Const, t, scalar(p), 0, 0, c});
+        }
+        if (t == Token::VarX) return push(ValueKind::Scalar, {OpCode::LoadX, t, scalar(p)});
+        if (t == Token::Load) return push(ValueKind::Scalar, {OpCode::Move, t, scalar(p), static_cast<uint16_t>(value)});
+        if (isMatrixToken(t)) { m_hasMatrices = true; return push(ValueKind::Matrix, {OpCode::MatLoad, t, reg(p)}); }
+        if (isListToken(t)) { m_hasLists = true; return push(ValueKind::List, {OpCode::ListLoad, t, reg(p)}); }
+
+        if (t == Token::Store) {
+            if (p < 1) return fail("Error");
+            if (m_kinds.back() != ValueKind::Scalar) return fail("Type Error");
+            emit({OpCode::Move, t, static_cast<uint16_t>(value), scalar(p - 1)});
+            return true;
+        }
+        if (t != Token::LinReg && (EOSPrecedence::is_function(t) || EOSPrecedence::is_postfix(t) || t == Token::Recip)) {
+            if (p < 1) return fail("Error");
+            return unary(t, p - 1);
+        }
+        if (p < 2) return fail("Error");
+        const ValueKind ka = m_kinds[p - 2], kb = m_kinds[p - 1];
+        m_kinds.pop_back();
+        if (t != Token::LinReg && !is_batch_binary(t)) { m_kinds.pop_back(); return true; } // The interpreter drops both operands of stray tokens
+        return binary(t, value, p - 2, ka, kb);
+    }
+
+    bool unary(Token t, int r) {
+        ValueKind& kind = m_kinds.back();
+        const uint16_t i = static_cast<uint16_t>(r);
+        if (t == Token::Det || t == Token::Transpose || (t == Token::Inverse && kind == ValueKind::Matrix)) {
+            if (kind != ValueKind::Matrix) return fail("Type Error");
+            if (t == Token::Det) { kind = ValueKind::Scalar; emit({OpCode::MatDet, t, scalar(r), i}); }
+            else emit({t == Token::Transpose ? OpCode::MatTranspose : OpCode::MatInverse, t, i, i});
+        } else if (t >= Token::Sum && t <= Token::CumSum) {
+            if (kind != ValueKind::List) return fail("Type Error");
+            const OpCode op = listReduction(t);
+            const bool toScalar = op == OpCode::ListSum || op == OpCode::ListMean || op == OpCode::ListStdDev;
+            if (toScalar) kind = ValueKind::Scalar;
+            emit({op, t, toScalar ? scalar(r) : i, i});
+        } else {
+            const std::optional<OpCode> op = scalarUnary(t);
+            if (!op) return fail("Error");
+            if (kind == ValueKind::List) emit({OpCode::ListMap, t, i, i});
+            else if (kind != ValueKind::Scalar) return fail("Type Error");
+            else emit({*op, t, scalar(r), scalar(r)});
+        }
+        return true;
+    }
+
+    bool binary(Token t, double value, int r, ValueKind ka, ValueKind kb) {
+        ValueKind& kind = m_kinds.back();
+        const uint16_t a = static_cast<uint16_t>(r), b = static_cast<uint16_t>(r + 1);
+        constexpr ValueKind S = ValueKind::Scalar, M = ValueKind::Matrix, L = ValueKind::List;
+        if (t == Token::LinReg) {
+            if (ka != L || kb != L) return fail("Type Error");
+            emit({OpCode::ListLinReg, t, a, a, b});
+            return true;
+        }
+        if (ka == S && kb == S) {
+            const Token token = t == Token::NotCompare ? static_cast<Token>(static_cast<int>(value)) : t;
+            emit({scalarBinary(t), token, scalar(r), scalar(r), scalar(r + 1)});
+            return true;
+        }
+        if ((ka == L || kb == L) && ka != M && kb != M && t != Token::NotCompare) { // Scalars broadcast over lists
+            kind = L;
+            if (ka == L && kb == L) emit({OpCode::ListList, t, a, a, b});
+            else if (ka == L) emit({OpCode::ListScalar, t, a, a, scalar(r + 1)});
+            else emit({OpCode::ScalarList, t, a, scalar(r), b});
+            return true;
+        }
+        if (ka == L || kb == L) return fail("Type Error");
+        if (t == Token::Mul) {
+            kind = M;
+            if (ka == M && kb == M) emit({OpCode::MatMul, t, a, a, b});
+            else if (ka == M) emit({OpCode::MatScale, t, a, a, scalar(r + 1)});
+            else emit({OpCode::ScaleMat, t, a, scalar(r), b});
+            return true;
+        }
+        if ((t == Token::Add || t == Token::Sub) && ka == M && kb == M) {
+            emit({t == Token::Add ? OpCode::MatAdd : OpCode::MatSub, t, a, a, b});
+            return true;
+        }
+        return fail("Type Error");
+    }
+
+    bool push(ValueKind kind, Instruction in) {
+        m_kinds.push_back(kind);
+        m_peak = std::max(m_peak, static_cast<int>(m_kinds.size()));
+        emit(in);
+        return true;
+    }
+    void emit(Instruction in) { m_out.code.push_back(in); }
+    bool fail(const char* message) { m_out.error = message; m_out.code.clear(); return false; }
+
+    int top() const { return static_cast<int>(m_kinds.size()) - 1; }
+    uint16_t scalar(int position) const { return static_cast<uint16_t>(m_slots + position); }
+    static uint16_t reg(int position) { return static_cast<uint16_t>(position); } // Matrix and list registers
+
+    int m_slots;
+    int m_peak = 0;
+    bool m_hasMatrices = false, m_hasLists = false;
+    std::vector<ValueKind> m_kinds; // Per operand stack position
+    Bytecode m_out;
+};
+
+// Mnemonic and register files of dst, a and b: 's', 'm', 'l', or 0 when unused
+struct OpInfo { const char* name; char dst, a, b; };
+constexpr OpInfo kOps[] = {
+    {"const", 's', 0, 0}, {"x", 's', 0, 0}, {"move", 's', 's', 0},
+    {"sin", 's', 's', 0}, {"cos", 's', 's', 0}, {"tan", 's', 's', 0}, {"log", 's', 's', 0}, {"ln", 's', 's', 0},
+    {"sqrt", 's', 's', 0}, {"asin", 's', 's', 0}, {"acos", 's', 's', 0}, {"atan", 's', 's', 0}, {"not", 's', 's', 0}, {"recip", 's', 's', 0}, {"inverse", 's', 's', 0},
+    {"add", 's', 's', 's'}, {"sub", 's', 's', 's'}, {"mul", 's', 's', 's'}, {"div", 's', 's', 's'}, {"pow", 's', 's', 's'},
+    {"eq", 's', 's', 's'}, {"ne", 's', 's', 's'}, {"lt", 's', 's', 's'}, {"le", 's', 's', 's'}, {"gt", 's', 's', 's'},
+    {"ge", 's', 's', 's'}, {"and", 's', 's', 's'}, {"or", 's', 's', 's'}, {"xor", 's', 's', 's'}, {"not-cmp", 's', 's', 's'},
+    {"load", 'm', 0, 0}, {"madd", 'm', 'm', 'm'}, {"msub", 'm', 'm', 'm'}, {"mmul", 'm', 'm', 'm'},
+    {"mscale", 'm', 'm', 's'}, {"scalem", 'm', 's', 'm'}, {"transpose", 'm', 'm', 0}, {"minverse", 'm', 'm', 0}, {"det", 's', 'm', 0},
+    {"load", 'l', 0, 0}, {"map", 'l', 'l', 0}, {"ll", 'l', 'l', 'l'}, {"ls", 'l', 'l', 's'}, {"sl", 'l', 's', 'l'},
+    {"sum", 's', 'l', 0}, {"mean", 's', 'l', 0}, {"stddev", 's', 'l', 0}, {"sorta", 'l', 'l', 0}, {"cumsum", 'l', 'l', 0},
+    {"linreg", 'l', 'l', 'l'},
+};
+static_assert(std::size(kOps) == static_cast<size_t>(OpCode::ListLinReg) + 1, "kOps must list every OpCode");
+
+} // namespace
+
+Bytecode compileBytecode(const RpnProgram& rpn, int slotCount) { return Compiler(rpn, slotCount).take(); }
+
+std::string disassemble(const Bytecode& bytecode) {
+    if (!bytecode.error.empty()) return "; " + bytecode.error + "\n";
+    auto reg = [](char file, int r) { return std::string(1, file) + std::to_string(r); };
+    std::string out;
+    for (const Instruction& in : bytecode.code) {
+        const OpInfo& info = kOps[static_cast<int>(in.op)];
+        std::string line = reg(info.dst, in.dst) + " = " + info.name;
+        if (in.op == OpCode::NotCompare) line = reg('s', in.dst) + " = not-" + kOps[static_cast<int>(scalarBinary(in.token))].name;
+        else if (in.op == OpCode::ListMap || in.op == OpCode::ListList || in.op == OpCode::ListScalar || in.op == OpCode::ScalarList)
+            line += std::string(".") + kOps[static_cast<int>(in.op == OpCode::ListMap ? *scalarUnary(in.token) : scalarBinary(in.token))].name;
+
+        if (in.op == OpCode::Const) {
+            char literal[32];
+            std::snprintf(literal, sizeof(literal), " %.17g", in.imm);
+            line += literal;
+        } else if (in.op == OpCode::MatLoad) {
+            line += std::string(" [") + static_cast<char>('A' + (static_cast<int>(in.token) - static_cast<int>(Token::MatA))) + "]";
+        } else if (in.op == OpCode::ListLoad) {
+            line += " L" + std::to_string(static_cast<int>(in.token) - static_cast<int>(Token::List1) + 1);
+        }
+        if (info.a) line += " " + reg(info.a, in.a);
+        if (info.b) line += ", " + reg(info.b, in.b);
+        out += line + "\n";
+    }
+    const char file = bytecode.resultKind == ValueKind::Scalar ? 's' : (bytecode.resultKind == ValueKind::Matrix ? 'm' : 'l');
+    out += "ret " + reg(file, bytecode.result) + "\n";
+    return out;
+}
+
+} // namespace tux_ti83
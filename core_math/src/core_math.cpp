@@ -1,19 +1,56 @@
 #include "capsules/capsule_math.hpp"
+#include "capsules/capsule_kernels.hpp"
+#include "capsules/capsule_optimizer.hpp"
+#include "capsules/capsule_profiler.hpp"
 #include <stack>
 #include <cmath>
 #include <algorithm>
 #include <string>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
 
 namespace tux_ti83 {
 
-std::map<Token, Matrix> MathStateMachine::matrixRegistry;
+namespace {
+
+std::atomic<std::shared_ptr<const RegistrySnapshot>>& currentRegistry() {
+    static std::atomic<std::shared_ptr<const RegistrySnapshot>> current{std::make_shared<const RegistrySnapshot>()};
+    return current;
+}
+
+// Writers serialise on this mutex only; readers keep whichever snapshot they loaded, old ones die with their last pin
+template <class Edit> uint64_t publishRegistry(Edit&& edit) {
+    static std::mutex writers;
+    std::lock_guard<std::mutex> lock(writers);
+    auto next = std::make_shared<RegistrySnapshot>(*currentRegistry().load(std::memory_order_acquire));
+    ++next->version;
+    edit(*next);
+    const uint64_t version = next->version;
+    currentRegistry().store(std::move(next), std::memory_order_release);
+    return version;
+}
+
+} // namespace
+
+std::shared_ptr<const RegistrySnapshot> MathStateMachine::registry() { return currentRegistry().load(std::memory_order_acquire); }
+
+uint64_t MathStateMachine::setMatrix(Token name, Matrix value) {
+    return publishRegistry([&](RegistrySnapshot& r) { r.matrices[name] = std::move(value); });
+}
+
+uint64_t MathStateMachine::setList(Token name, List value) {
+    return publishRegistry([&](RegistrySnapshot& r) { r.lists[name] = std::move(value); });
+}
 
 int EOSPrecedence::precedence(Token t) {
     switch (t) {
         case Token::Sin: case Token::Cos: case Token::Tan:
         case Token::ASin: case Token::ACos: case Token::ATan:
         case Token::Log: case Token::Ln: case Token::Sqrt: 
-        case Token::Not: return 4;
+        case Token::Not: case Token::Det:
+        case Token::Sum: case Token::Mean: case Token::StdDev:
+        case Token::SortA: case Token::CumSum: case Token::LinReg: return 4;
         case Token::Pow: return 3;
         case Token::Mul: case Token::Div: return 2;
         case Token::Add: case Token::Sub: return 1;
@@ -31,29 +68,108 @@ bool EOSPrecedence::is_operator(Token t) { return precedence(t) != 0 && !is_func
 bool EOSPrecedence::is_function(Token t) { 
     return (t == Token::Sin || t == Token::Cos || t == Token::Tan || 
             t == Token::ASin || t == Token::ACos || t == Token::ATan ||
-            t == Token::Log || t == Token::Ln || t == Token::Sqrt || t == Token::Not); 
+            t == Token::Log || t == Token::Ln || t == Token::Sqrt || t == Token::Not || t == Token::Det ||
+            (t >= Token::Sum && t <= Token::LinReg)); 
+}
+bool EOSPrecedence::is_postfix(Token t) { return (t == Token::Transpose || t == Token::Inverse); }
+
+namespace {
+
+constexpr size_t kBatchBlock = 256; // Samples per column; keeps every stack column resident in L1
+constexpr int kInlineRegisters = 32; // Scalar register file kept on the C++ stack; deeper programs spill to the heap
+
+bool toB(double v) { return std::abs(v) > 1e-9; }
+
+// Matrix operand held as a pending sum of scaled handles: +, − and scalar × only edit coefficients, and the
+// elements are produced in one pass (one allocation) when a kernel or the caller needs them
+struct LazyMatrix {
+    int rows = 0, cols = 0;
+    std::vector<MatrixTerm> terms;
+
+    static LazyMatrix of(double coeff, Matrix m) { LazyMatrix l{m.rows, m.cols, {}}; l.terms.push_back({coeff, std::move(m)}); return l; }
+    void scale(double s) { for (auto& t : terms) t.coeff *= s; }
+    void add(LazyMatrix&& other, double sign) {
+        for (auto& term : other.terms) {
+            auto same = std::find_if(terms.begin(), terms.end(), [&](const MatrixTerm& t) { return t.mat.sharesStorageWith(term.mat); });
+            if (same != terms.end()) same->coeff += sign * term.coeff;
+            else terms.push_back({sign * term.coeff, std::move(term.mat)});
+        }
+    }
+    // Consumes the operand; a single term hands back its handle untouched so callers can fold `coeff` into their result
+    Matrix take(double& coeff) {
+        if (terms.size() == 1) { coeff = terms[0].coeff; return std::move(terms[0].mat); }
+        coeff = 1.0; return matrixCombine(terms);
+    }
+    Matrix materialise() {
+        double c; Matrix m = take(c);
+        if (c == 1.0) return m;
+        if (m.isShared()) return matrixScale(m, c);
+        double* d = m.mutableData();
+        for (size_t i = 0; i < m.size(); ++i) d[i] *= c;
+        return m;
+    }
+};
+
+} // namespace
+
+bool is_batch_binary(Token t) {
+    return (t >= Token::Add && t <= Token::Pow) || (t >= Token::Equal && t <= Token::Xor) || t == Token::NotCompare;
 }
 
-Matrix matrixAdd(const Matrix& a, const Matrix& b) {
-    if (a.rows != b.rows || a.cols != b.cols) return {};
-    Matrix res = a;
-    for (size_t i = 0; i < a.data.size(); ++i) res.data[i] += b.data[i];
-    return res;
+// Plain indexed loops over contiguous columns so the compiler can vectorize them
+void applyUnary(Token t, double* v, size_t n) {
+    switch (t) {
+        case Token::Sin: for (size_t i = 0; i < n; ++i) v[i] = std::sin(v[i]); break;
+        case Token::Cos: for (size_t i = 0; i < n; ++i) v[i] = std::cos(v[i]); break;
+        case Token::Tan: for (size_t i = 0; i < n; ++i) v[i] = std::tan(v[i]); break;
+        case Token::Sqrt: for (size_t i = 0; i < n; ++i) v[i] = (v[i] >= 0) ? std::sqrt(v[i]) : 0.0; break;
+        case Token::Log: for (size_t i = 0; i < n; ++i) v[i] = (v[i] > 0) ? std::log10(v[i]) : -HUGE_VAL; break;
+        case Token::Ln: for (size_t i = 0; i < n; ++i) v[i] = (v[i] > 0) ? std::log(v[i]) : -HUGE_VAL; break;
+        case Token::ASin: for (size_t i = 0; i < n; ++i) v[i] = std::asin(v[i]); break;
+        case Token::ACos: for (size_t i = 0; i < n; ++i) v[i] = std::acos(v[i]); break;
+        case Token::ATan: for (size_t i = 0; i < n; ++i) v[i] = std::atan(v[i]); break;
+        case Token::Not: for (size_t i = 0; i < n; ++i) v[i] = toB(v[i]) ? 0.0 : 1.0; break;
+        case Token::Inverse: for (size_t i = 0; i < n; ++i) v[i] = (v[i] == 0) ? 0.0 : 1.0 / v[i]; break;
+        case Token::Recip: for (size_t i = 0; i < n; ++i) v[i] = 1.0 / v[i]; break; // X^-1 exactly, including 0 → ∞
+        default: break;
+    }
 }
 
-Matrix matrixMul(const Matrix& a, const Matrix& b) {
-    if (a.cols != b.rows) return {};
-    Matrix res; res.rows = a.rows; res.cols = b.cols;
-    res.data.resize(res.rows * res.cols, 0.0);
-    for (int i = 0; i < a.rows; ++i)
-        for (int j = 0; j < b.cols; ++j)
-            for (int k = 0; k < a.cols; ++k)
-                res.data[i * b.cols + j] += a.at(i, k) * b.at(k, j);
-    return res;
+void applyBinary(Token t, double* __restrict a, const double* __restrict b, size_t n) {
+    switch (t) {
+        case Token::Add: for (size_t i = 0; i < n; ++i) a[i] += b[i]; break;
+        case Token::Sub: for (size_t i = 0; i < n; ++i) a[i] -= b[i]; break;
+        case Token::Mul: for (size_t i = 0; i < n; ++i) a[i] *= b[i]; break;
+        case Token::Div: for (size_t i = 0; i < n; ++i) a[i] = (b[i] == 0) ? 0.0 : a[i] / b[i]; break;
+        case Token::Pow: for (size_t i = 0; i < n; ++i) a[i] = std::pow(a[i], b[i]); break;
+        case Token::Equal: for (size_t i = 0; i < n; ++i) a[i] = std::abs(a[i] - b[i]) < 1e-9 ? 1.0 : 0.0; break;
+        case Token::NotEqual: for (size_t i = 0; i < n; ++i) a[i] = std::abs(a[i] - b[i]) > 1e-9 ? 1.0 : 0.0; break;
+        case Token::Less: for (size_t i = 0; i < n; ++i) a[i] = a[i] < b[i] ? 1.0 : 0.0; break;
+        case Token::LessEq: for (size_t i = 0; i < n; ++i) a[i] = a[i] <= b[i] ? 1.0 : 0.0; break;
+        case Token::Greater: for (size_t i = 0; i < n; ++i) a[i] = a[i] > b[i] ? 1.0 : 0.0; break;
+        case Token::GreaterEq: for (size_t i = 0; i < n; ++i) a[i] = a[i] >= b[i] ? 1.0 : 0.0; break;
+        case Token::And: for (size_t i = 0; i < n; ++i) a[i] = (toB(a[i]) && toB(b[i])) ? 1.0 : 0.0; break;
+        case Token::Or: for (size_t i = 0; i < n; ++i) a[i] = (toB(a[i]) || toB(b[i])) ? 1.0 : 0.0; break;
+        case Token::Xor: for (size_t i = 0; i < n; ++i) a[i] = (toB(a[i]) ^ toB(b[i])) ? 1.0 : 0.0; break;
+        default: break;
+    }
 }
 
-CalculationResult MathStateMachine::evaluate(const std::vector<Token>& tokens, double xValue) {
-    if (tokens.empty()) return {false, 0.0, {}, false, "Empty"};
+void applyNotCompare(Token cmp, double* __restrict a, const double* __restrict b, size_t n) {
+    switch (cmp) {
+        case Token::Equal: for (size_t i = 0; i < n; ++i) a[i] = std::abs(a[i] - b[i]) < 1e-9 ? 0.0 : 1.0; break;
+        case Token::NotEqual: for (size_t i = 0; i < n; ++i) a[i] = std::abs(a[i] - b[i]) > 1e-9 ? 0.0 : 1.0; break;
+        case Token::Less: for (size_t i = 0; i < n; ++i) a[i] = a[i] < b[i] ? 0.0 : 1.0; break;
+        case Token::LessEq: for (size_t i = 0; i < n; ++i) a[i] = a[i] <= b[i] ? 0.0 : 1.0; break;
+        case Token::Greater: for (size_t i = 0; i < n; ++i) a[i] = a[i] > b[i] ? 0.0 : 1.0; break;
+        case Token::GreaterEq: for (size_t i = 0; i < n; ++i) a[i] = a[i] >= b[i] ? 0.0 : 1.0; break;
+        default: break;
+    }
+}
+
+CompiledExpression::CompiledExpression(const std::vector<Token>& tokens, bool optimize) {
+    if (tokens.empty()) { m_error = "Empty"; return; }
+    TUX_PROFILE_STAGE(Parse);
 
     std::vector<double> numericValues;
     std::vector<Token> processedTokens; 
@@ -61,104 +177,238 @@ CalculationResult MathStateMachine::evaluate(const std::vector<Token>& tokens, d
     auto flushNum = [&]() {
         if (!currentNumStr.empty()) {
             processedTokens.push_back(Token::Num0);
-            numericValues.push_back(std::stod(currentNumStr));
+            numericValues.push_back(std::strtod(currentNumStr.c_str(), nullptr));
             currentNumStr = "";
         }
     };
 
     for (auto t : tokens) {
         int val = (int)t;
-        if (val >= 0 && val <= 9) currentNumStr += std::to_string(val);
+        if (val >= 0 && val <= 9) currentNumStr += static_cast<char>('0' + val);
         else if (t == Token::Decimal) currentNumStr += ".";
         else { flushNum(); processedTokens.push_back(t); }
     }
     flushNum();
 
-    std::vector<std::pair<Token, double>> rpn;
     std::stack<Token> opStack;
     int numIdx = 0;
     for (auto t : processedTokens) {
-        if (t == Token::Num0) rpn.push_back({t, numericValues[numIdx++]});
-        else if ((t >= Token::MatA && t <= Token::MatJ) || t == Token::VarX || t == Token::Pi || t == Token::E) rpn.push_back({t, 0.0});
+        if (t == Token::Num0) m_rpn.push_back({t, numericValues[numIdx++]});
+        else if ((t >= Token::MatA && t <= Token::MatJ) || (t >= Token::List1 && t <= Token::List6) ||
+                 t == Token::VarX || t == Token::Pi || t == Token::E) m_rpn.push_back({t, 0.0});
+        else if (EOSPrecedence::is_postfix(t)) m_rpn.push_back({t, 0.0}); // Binds to the operand just emitted
         else if (EOSPrecedence::is_function(t) || t == Token::LeftParen) opStack.push(t);
+        else if (t == Token::Comma) { // Closes one argument of LinReg(
+            while (!opStack.empty() && opStack.top() != Token::LeftParen) { m_rpn.push_back({opStack.top(), 0.0}); opStack.pop(); }
+        }
         else if (t == Token::RightParen) {
-            while (!opStack.empty() && opStack.top() != Token::LeftParen) { rpn.push_back({opStack.top(), 0.0}); opStack.pop(); }
+            while (!opStack.empty() && opStack.top() != Token::LeftParen) { m_rpn.push_back({opStack.top(), 0.0}); opStack.pop(); }
             if (!opStack.empty()) opStack.pop();
-            if (!opStack.empty() && EOSPrecedence::is_function(opStack.top())) { rpn.push_back({opStack.top(), 0.0}); opStack.pop(); }
+            if (!opStack.empty() && EOSPrecedence::is_function(opStack.top())) { m_rpn.push_back({opStack.top(), 0.0}); opStack.pop(); }
         } else {
             while (!opStack.empty() && opStack.top() != Token::LeftParen && 
                    EOSPrecedence::precedence(opStack.top()) >= EOSPrecedence::precedence(t)) {
-                rpn.push_back({opStack.top(), 0.0}); opStack.pop();
+                m_rpn.push_back({opStack.top(), 0.0}); opStack.pop();
             }
             opStack.push(t);
         }
     }
-    while (!opStack.empty()) { rpn.push_back({opStack.top(), 0.0}); opStack.pop(); }
-
-    struct Operand { bool isMat; double val; Matrix mat; };
-    std::stack<Operand> stack;
-    auto toB = [](double v) { return std::abs(v) > 1e-9; };
-
-    for (auto& node : rpn) {
-        Token t = node.first;
-        if (t == Token::Num0) stack.push({false, node.second, {}});
-        else if (t == Token::VarX) stack.push({false, xValue, {}});
-        else if (t == Token::Pi) stack.push({false, M_PI, {}});
-        else if (t == Token::E) stack.push({false, M_E, {}});
-        else if (t >= Token::MatA && t <= Token::MatJ) {
-            if (matrixRegistry.count(t)) stack.push({true, 0.0, matrixRegistry[t]});
-            else return {false, 0.0, {}, false, "Undefined Matrix"};
-        } else if (EOSPrecedence::is_function(t)) {
-            if (stack.empty()) return {false, 0.0, {}, false, "Error"};
-            Operand a = stack.top(); stack.pop();
-            if (a.isMat) return {false, 0.0, {}, false, "Type Error"};
-            double v = a.val;
-            if (t == Token::Sin) v = std::sin(v);
-            else if (t == Token::Cos) v = std::cos(v);
-            else if (t == Token::Tan) v = std::tan(v);
-            else if (t == Token::Sqrt) v = (v >= 0) ? std::sqrt(v) : 0.0;
-            else if (t == Token::Log) v = (v > 0) ? std::log10(v) : -HUGE_VAL;
-            else if (t == Token::Ln) v = (v > 0) ? std::log(v) : -HUGE_VAL;
-            else if (t == Token::Not) v = toB(v) ? 0.0 : 1.0;
-            stack.push({false, v, {}});
-        } else {
-            if (stack.size() < 2) return {false, 0.0, {}, false, "Error"};
-            Operand b = stack.top(); stack.pop();
-            Operand a = stack.top(); stack.pop();
-
-            if (t == Token::Add) {
-                if (a.isMat && b.isMat) stack.push({true, 0.0, matrixAdd(a.mat, b.mat)});
-                else if (!a.isMat && !b.isMat) stack.push({false, a.val + b.val, {}});
-                else return {false, 0.0, {}, false, "Type Error"};
-            } else if (t == Token::Sub) {
-                if (!a.isMat && !b.isMat) stack.push({false, a.val - b.val, {}});
-                else return {false, 0.0, {}, false, "Type Error"};
-            } else if (t == Token::Mul) {
-                if (a.isMat && b.isMat) stack.push({true, 0.0, matrixMul(a.mat, b.mat)});
-                else if (a.isMat && !b.isMat) { Matrix m = a.mat; for(auto& v : m.data) v *= b.val; stack.push({true, 0.0, m}); }
-                else if (!a.isMat && b.isMat) { Matrix m = b.mat; for(auto& v : m.data) v *= a.val; stack.push({true, 0.0, m}); }
-                else stack.push({false, a.val * b.val, {}});
-            } else if (t == Token::Div) {
-                if (!a.isMat && !b.isMat) stack.push({false, b.val == 0 ? 0.0 : a.val / b.val, {}});
-                else return {false, 0.0, {}, false, "Type Error"};
-            } else if (t == Token::Pow) {
-                if (!a.isMat && !b.isMat) stack.push({false, std::pow(a.val, b.val), {}});
-                else return {false, 0.0, {}, false, "Type Error"};
-            } else if (t == Token::Equal) stack.push({false, std::abs(a.val - b.val) < 1e-9 ? 1.0 : 0.0, {}});
-            else if (t == Token::NotEqual) stack.push({false, std::abs(a.val - b.val) > 1e-9 ? 1.0 : 0.0, {}});
-            else if (t == Token::Less) stack.push({false, a.val < b.val ? 1.0 : 0.0, {}});
-            else if (t == Token::LessEq) stack.push({false, a.val <= b.val ? 1.0 : 0.0, {}});
-            else if (t == Token::Greater) stack.push({false, a.val > b.val ? 1.0 : 0.0, {}});
-            else if (t == Token::GreaterEq) stack.push({false, a.val >= b.val ? 1.0 : 0.0, {}});
-            else if (t == Token::And) stack.push({false, (toB(a.val) && toB(b.val)) ? 1.0 : 0.0, {}});
-            else if (t == Token::Or) stack.push({false, (toB(a.val) || toB(b.val)) ? 1.0 : 0.0, {}});
-            else if (t == Token::Xor) stack.push({false, (toB(a.val) ^ toB(b.val)) ? 1.0 : 0.0, {}});
+    while (!opStack.empty()) { m_rpn.push_back({opStack.top(), 0.0}); opStack.pop(); }
+
+    m_code = compileBytecode(m_rpn, 0);
+    if (m_code.error.empty() && optimize) {
+        OptimizedProgram optimized = optimizeProgram(m_rpn);
+        if (optimized.changed) {
+            m_rpn = std::move(optimized.rpn);
+            m_code = compileBytecode(m_rpn, optimized.slotCount);
+        }
+    }
+    m_error = m_code.error;
+}
+
+CalculationResult CompiledExpression::evaluate(double xValue) const {
+    if (!m_code.usesRegistry) return evaluatePinned(xValue, nullptr);
+    return evaluatePinned(xValue, MathStateMachine::registry().get()); // The temporary pin lives to the end of the statement
+}
+
+CalculationResult CompiledExpression::evaluate(double xValue, const RegistrySnapshot& registry) const {
+    return evaluatePinned(xValue, &registry);
+}
+
+CalculationResult CompiledExpression::evaluatePinned(double xValue, const RegistrySnapshot* registry) const {
+    if (!m_error.empty()) return {.success = false, .error_message = m_error};
+
+    double inlineRegisters[kInlineRegisters];
+    std::vector<double> spilled;
+    double* s = inlineRegisters;
+    if (m_code.scalarRegisters > kInlineRegisters) { spilled.resize(m_code.scalarRegisters); s = spilled.data(); }
+    std::vector<LazyMatrix> m(m_code.matrixRegisters); // Both empty, so never allocated, for scalar programs
+    std::vector<List> l(m_code.listRegisters);
+
+    // Types and depths were checked by compileBytecode(): only registry and dimension errors remain.
+    // Unary and binary instructions always have dst == a.
+    for (const Instruction& in : m_code.code) {
+        switch (in.op) { // Dense OpCode values: a single jump table
+            case OpCode::Const: s[in.dst] = in.imm; break;
+            case OpCode::LoadX: s[in.dst] = xValue; break;
+            case OpCode::Move: s[in.dst] = s[in.a]; break;
+            case OpCode::Sin: s[in.dst] = std::sin(s[in.a]); break;
+            case OpCode::Cos: s[in.dst] = std::cos(s[in.a]); break;
+            case OpCode::Tan: s[in.dst] = std::tan(s[in.a]); break;
+            case OpCode::Log: s[in.dst] = s[in.a] > 0 ? std::log10(s[in.a]) : -HUGE_VAL; break;
+            case OpCode::Ln: s[in.dst] = s[in.a] > 0 ? std::log(s[in.a]) : -HUGE_VAL; break;
+            case OpCode::Sqrt: s[in.dst] = s[in.a] >= 0 ? std::sqrt(s[in.a]) : 0.0; break;
+            case OpCode::ASin: s[in.dst] = std::asin(s[in.a]); break;
+            case OpCode::ACos: s[in.dst] = std::acos(s[in.a]); break;
+            case OpCode::ATan: s[in.dst] = std::atan(s[in.a]); break;
+            case OpCode::Not: s[in.dst] = toB(s[in.a]) ? 0.0 : 1.0; break;
+            case OpCode::Recip: s[in.dst] = 1.0 / s[in.a]; break;
+            case OpCode::ScalarInverse: s[in.dst] = s[in.a] == 0 ? 0.0 : 1.0 / s[in.a]; break;
+            case OpCode::Add: s[in.dst] = s[in.a] + s[in.b]; break;
+            case OpCode::Sub: s[in.dst] = s[in.a] - s[in.b]; break;
+            case OpCode::Mul: s[in.dst] = s[in.a] * s[in.b]; break;
+            case OpCode::Div: s[in.dst] = s[in.b] == 0 ? 0.0 : s[in.a] / s[in.b]; break;
+            case OpCode::Pow: s[in.dst] = std::pow(s[in.a], s[in.b]); break;
+            case OpCode::Equal: s[in.dst] = std::abs(s[in.a] - s[in.b]) < 1e-9 ? 1.0 : 0.0; break;
+            case OpCode::NotEqual: s[in.dst] = std::abs(s[in.a] - s[in.b]) > 1e-9 ? 1.0 : 0.0; break;
+            case OpCode::Less: s[in.dst] = s[in.a] < s[in.b] ? 1.0 : 0.0; break;
+            case OpCode::LessEq: s[in.dst] = s[in.a] <= s[in.b] ? 1.0 : 0.0; break;
+            case OpCode::Greater: s[in.dst] = s[in.a] > s[in.b] ? 1.0 : 0.0; break;
+            case OpCode::GreaterEq: s[in.dst] = s[in.a] >= s[in.b] ? 1.0 : 0.0; break;
+            case OpCode::And: s[in.dst] = (toB(s[in.a]) && toB(s[in.b])) ? 1.0 : 0.0; break;
+            case OpCode::Or: s[in.dst] = (toB(s[in.a]) || toB(s[in.b])) ? 1.0 : 0.0; break;
+            case OpCode::Xor: s[in.dst] = (toB(s[in.a]) ^ toB(s[in.b])) ? 1.0 : 0.0; break;
+            case OpCode::NotCompare: applyNotCompare(in.token, &s[in.dst], &s[in.b], 1); break;
+            case OpCode::MatLoad: {
+                auto it = registry->matrices.find(in.token);
+                if (it == registry->matrices.end()) return {.success = false, .error_message = "Undefined Matrix"};
+                m[in.dst] = LazyMatrix::of(1.0, it->second); // Shares the snapshot's storage
+                break;
+            }
+            case OpCode::MatAdd: case OpCode::MatSub:
+                if (m[in.a].rows != m[in.b].rows || m[in.a].cols != m[in.b].cols) return {.success = false, .error_message = "Dim Mismatch"};
+                m[in.dst].add(std::move(m[in.b]), in.op == OpCode::MatAdd ? 1.0 : -1.0);
+                break;
+            case OpCode::MatMul: {
+                if (m[in.a].cols != m[in.b].rows) return {.success = false, .error_message = "Dim Mismatch"};
+                double ca, cb;
+                Matrix ma = m[in.a].take(ca), mb = m[in.b].take(cb);
+                m[in.dst] = LazyMatrix::of(ca * cb, matrixMul(ma, mb));
+                break;
+            }
+            case OpCode::MatScale: m[in.dst].scale(s[in.b]); break;
+            case OpCode::ScaleMat: m[in.dst] = std::move(m[in.b]); m[in.dst].scale(s[in.a]); break;
+            case OpCode::MatTranspose: {
+                double c; Matrix mt = m[in.a].take(c);
+                matrixTranspose(mt);
+                m[in.dst] = LazyMatrix::of(c, std::move(mt));
+                break;
+            }
+            case OpCode::MatInverse: {
+                if (m[in.a].rows != m[in.a].cols) return {.success = false, .error_message = "Dim Mismatch"};
+                double c; Matrix mi = m[in.a].take(c), inv;
+                if (c == 0 || !matrixInverse(mi, inv)) return {.success = false, .error_message = "Singular Matrix"};
+                m[in.dst] = LazyMatrix::of(1.0 / c, std::move(inv));
+                break;
+            }
+            case OpCode::MatDet: {
+                if (m[in.a].rows != m[in.a].cols) return {.success = false, .error_message = "Dim Mismatch"};
+                double c; Matrix md = m[in.a].take(c);
+                s[in.dst] = std::pow(c, md.rows) * matrixDeterminant(md);
+                break;
+            }
+            case OpCode::ListLoad: {
+                auto it = registry->lists.find(in.token);
+                if (it == registry->lists.end()) return {.success = false, .error_message = "Undefined List"};
+                l[in.dst] = it->second; // Shares the snapshot's storage until the first element-wise write
+                break;
+            }
+            case OpCode::ListMap: listApply(in.token, l[in.dst]); break;
+            case OpCode::ListList:
+                if (l[in.a].size() != l[in.b].size()) return {.success = false, .error_message = "Dim Mismatch"};
+                listApply(in.token, l[in.dst], l[in.b]);
+                break;
+            case OpCode::ListScalar: listApply(in.token, l[in.dst], s[in.b]); break;
+            case OpCode::ScalarList: listApply(in.token, s[in.a], l[in.b]); l[in.dst] = std::move(l[in.b]); break;
+            case OpCode::ListSum: s[in.dst] = listSum(l[in.a]); break;
+            case OpCode::ListMean:
+                if (l[in.a].size() < 1) return {.success = false, .error_message = "Stat Error"};
+                s[in.dst] = listMean(l[in.a]);
+                break;
+            case OpCode::ListStdDev:
+                if (l[in.a].size() < 2) return {.success = false, .error_message = "Stat Error"};
+                s[in.dst] = listStdDev(l[in.a]);
+                break;
+            case OpCode::ListSortA: l[in.dst] = listSortA(std::move(l[in.a])); break;
+            case OpCode::ListCumSum: l[in.dst] = listCumSum(std::move(l[in.a])); break;
+            case OpCode::ListLinReg: {
+                if (l[in.a].size() != l[in.b].size()) return {.success = false, .error_message = "Dim Mismatch"};
+                const LinearFit fit = linearRegression(l[in.a], l[in.b]);
+                if (!fit.success) return {.success = false, .error_message = "Stat Error"};
+                l[in.dst] = List({fit.a, fit.b, fit.r});
+                break;
+            }
+        }
+    }
+
+    if (m_code.resultKind == ValueKind::Matrix) return {.success = true, .matrixValue = m[m_code.result].materialise(), .isMatrix = true};
+    if (m_code.resultKind == ValueKind::List) return {.success = true, .listValue = std::move(l[m_code.result]), .isList = true};
+    return {.success = true, .value = s[m_code.result]};
+}
+
+bool CompiledExpression::evaluateBatch(std::span<const double> xs, std::span<double> ys) const {
+    if (!m_code.usesRegistry) return evaluateBatchPinned(xs, ys, nullptr);
+    return evaluateBatchPinned(xs, ys, MathStateMachine::registry().get()); // Every sample sees one version
+}
+
+bool CompiledExpression::evaluateBatch(std::span<const double> xs, std::span<double> ys, const RegistrySnapshot& registry) const {
+    return evaluateBatchPinned(xs, ys, &registry);
+}
+
+bool CompiledExpression::evaluateBatchPinned(std::span<const double> xs, std::span<double> ys, const RegistrySnapshot* registry) const {
+    const size_t n = std::min(xs.size(), ys.size());
+    TUX_PROFILE_STAGE(Evaluate);
+    TUX_PROFILE_COUNT(Evaluations, n);
+    auto fail = [&]() { std::fill(ys.begin(), ys.end(), std::nan("")); return false; };
+    if (!m_error.empty() || m_code.resultKind != ValueKind::Scalar) return fail();
+
+    if (m_code.usesRegistry) {
+        for (size_t i = 0; i < n; ++i) {
+            CalculationResult res = evaluatePinned(xs[i], registry);
+            if (!res.success) return fail();
+            ys[i] = res.value;
         }
+        return true;
     }
 
-    if (stack.empty()) return {false, 0.0, {}, false, "Error"};
-    Operand res = stack.top();
-    return {true, res.val, res.mat, res.isMat, ""};
+    // One column of kBatchBlock samples per scalar register; the instruction's token selects the kernel
+    std::vector<double> columns(static_cast<size_t>(m_code.scalarRegisters) * kBatchBlock);
+    auto col = [&](int r) { return columns.data() + static_cast<size_t>(r) * kBatchBlock; };
+    for (size_t base = 0; base < n; base += kBatchBlock) {
+        const size_t len = std::min(kBatchBlock, n - base);
+        for (const Instruction& in : m_code.code) {
+            switch (in.op) {
+                case OpCode::Const: std::fill_n(col(in.dst), len, in.imm); break;
+                case OpCode::LoadX: std::copy_n(xs.data() + base, len, col(in.dst)); break;
+                case OpCode::Move: std::copy_n(col(in.a), len, col(in.dst)); break;
+                case OpCode::NotCompare: applyNotCompare(in.token, col(in.dst), col(in.b), len); break;
+                default:
+                    if (in.op <= OpCode::ScalarInverse) applyUnary(in.token, col(in.dst), len);
+                    else applyBinary(in.token, col(in.dst), col(in.b), len);
+                    break;
+            }
+        }
+        std::copy_n(col(m_code.result), len, ys.data() + base);
+    }
+    return true;
+}
+
+CalculationResult MathStateMachine::evaluate(const std::vector<Token>& tokens, double xValue) {
+    return CompiledExpression(tokens).evaluate(xValue);
+}
+
+bool MathStateMachine::evaluateBatch(const std::vector<Token>& tokens, std::span<const double> xs, std::span<double> ys) {
+    return CompiledExpression(tokens).evaluateBatch(xs, ys);
 }
 
 std::string MathStateMachine::toFraction(double value, double tolerance) {
@@ -0,0 +1,334 @@
+#include "capsules/capsule_interval.hpp"
+#include "capsules/capsule_profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace tux_ti83 {
+
+namespace {
+
+constexpr double kInf = HUGE_VAL;
+constexpr double kTruthy = 1e-9;  // toB(): |v| > 1e-9 is true
+constexpr double kTwoPi = 2.0 * M_PI;
+constexpr double kMaxTrigArg = 1e8; // Beyond this the period arithmetic below is too coarse to trust
+constexpr int kInlineRegisters = 32; // As the scalar VM: deeper programs spill to the heap
+
+// One ulp outward per operation covers the ≤1 ulp error of IEEE arithmetic and glibc's libm; a NaN
+// endpoint (∞−∞, 0·∞, ∞/∞) widens to the whole line on that side
+double down(double v) { return std::isnan(v) ? -kInf : std::nextafter(v, -kInf); }
+double up(double v) { return std::isnan(v) ? kInf : std::nextafter(v, kInf); }
+
+Interval make(double lo, double hi, bool nan) { return {down(lo), up(hi), nan}; }
+Interval exact(double lo, double hi, bool nan) { return {lo, hi, nan}; }
+Interval empty() { return {kInf, -kInf, true}; } // Only NaN comes out
+Interval boolean(bool canTrue, bool canFalse) { return {canFalse ? 0.0 : 1.0, canTrue ? 1.0 : 0.0, false}; }
+
+bool isEmpty(const Interval& a) { return a.lo > a.hi; }
+bool containsZero(const Interval& a) { return a.lo <= 0 && a.hi >= 0; }
+bool unbounded(const Interval& a) { return std::isinf(a.lo) || std::isinf(a.hi); }
+bool canBeTrue(const Interval& a) { return !isEmpty(a) && (a.lo < -kTruthy || a.hi > kTruthy); }
+bool canBeFalse(const Interval& a) { return a.nan || (!isEmpty(a) && a.lo <= kTruthy && a.hi >= -kTruthy); }
+
+Interval hull(const Interval& a, const Interval& b) {
+    if (isEmpty(a)) return {b.lo, b.hi, a.nan || b.nan};
+    if (isEmpty(b)) return {a.lo, a.hi, a.nan || b.nan};
+    return {std::min(a.lo, b.lo), std::max(a.hi, b.hi), a.nan || b.nan};
+}
+
+// min/max of candidate endpoint values, any NaN making that side unbounded
+Interval span(std::initializer_list<double> values, bool nan) {
+    double lo = kInf, hi = -kInf;
+    for (double v : values) {
+        if (std::isnan(v)) return {-kInf, kInf, true};
+        lo = std::min(lo, v); hi = std::max(hi, v);
+    }
+    return make(lo, hi, nan);
+}
+
+Interval add(const Interval& a, const Interval& b) {
+    if (isEmpty(a) || isEmpty(b)) return empty();
+    const bool nan = a.nan || b.nan || (a.hi == kInf && b.lo == -kInf) || (a.lo == -kInf && b.hi == kInf);
+    return make(a.lo + b.lo, a.hi + b.hi, nan);
+}
+
+Interval negate(const Interval& a) { return {-a.hi, -a.lo, a.nan}; }
+
+// 0 × anything is 0 here: a real 0 × ∞ is NaN, which the nan flag records
+double times(double x, double y) { return (x == 0 || y == 0) ? 0.0 : x * y; }
+
+Interval mul(const Interval& a, const Interval& b) {
+    if (isEmpty(a) || isEmpty(b)) return empty();
+    const bool nan = a.nan || b.nan || (containsZero(a) && unbounded(b)) || (containsZero(b) && unbounded(a));
+    return span({times(a.lo, b.lo), times(a.lo, b.hi), times(a.hi, b.lo), times(a.hi, b.hi)}, nan);
+}
+
+Interval square(const Interval& a) {
+    if (isEmpty(a)) return empty();
+    const double l = a.lo * a.lo, h = a.hi * a.hi;
+    if (containsZero(a)) return {0.0, up(std::max(l, h)), a.nan};
+    return make(std::min(l, h), std::max(l, h), a.nan);
+}
+
+// a / b for b not containing 0
+Interval divideNonZero(const Interval& a, const Interval& b, bool nan) {
+    return span({a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi}, nan || (unbounded(a) && unbounded(b)));
+}
+
+// The evaluator's division: x ÷ 0 is 0
+Interval div(const Interval& a, const Interval& b) {
+    if (isEmpty(b)) return empty();
+    const bool nan = a.nan || b.nan;
+    if (isEmpty(a)) return containsZero(b) ? exact(0.0, 0.0, true) : empty();
+    if (!containsZero(b)) return divideNonZero(a, b, nan);
+    if (b.lo == 0 && b.hi == 0) return exact(0.0, 0.0, b.nan);
+    if (a.lo == 0 && a.hi == 0) return exact(0.0, 0.0, nan);
+    // Quotients over the non-zero part of b run off to ±∞ at 0; the sign is fixed when a and b are one-signed
+    if (b.lo == 0) {
+        if (a.lo >= 0) return exact(0.0, kInf, nan);
+        if (a.hi <= 0) return exact(-kInf, 0.0, nan);
+    } else if (b.hi == 0) {
+        if (a.lo >= 0) return exact(-kInf, 0.0, nan);
+        if (a.hi <= 0) return exact(0.0, kInf, nan);
+    }
+    return exact(-kInf, kInf, nan);
+}
+
+// x^-1 exactly: 1 ÷ 0 is ±∞
+Interval recip(const Interval& a) {
+    if (isEmpty(a)) return empty();
+    if (containsZero(a)) return exact(-kInf, kInf, a.nan);
+    return divideNonZero(Interval::point(1.0), a, a.nan);
+}
+
+bool isInteger(double v) { return std::abs(v) < 9007199254740992.0 && v == std::floor(v); }
+
+Interval pow(const Interval& a, const Interval& b) {
+    if (a.nan || b.nan || isEmpty(a) || isEmpty(b)) return Interval::entire(); // pow(NaN, 0) and pow(1, NaN) are 1
+    if (b.lo == b.hi) {
+        const double p = b.lo;
+        if (p == 0) return Interval::point(1.0); // Even for NaN, ±∞ and 0
+        if (isInteger(p)) {
+            // xⁿ is monotone on either side of 0; across 0 even powers bottom out at 0, negative powers have a pole
+            const Interval ends = span({std::pow(a.lo, p), std::pow(a.hi, p)}, false);
+            if (a.lo >= 0 || a.hi <= 0) return ends;
+            if (p < 0) return exact(-kInf, kInf, false);
+            if (std::fmod(p, 2.0) == 0) return {0.0, ends.hi, false};
+            return ends;
+        }
+        // Fractional powers: NaN for negative bases, monotone on [0, ∞)
+        if (a.hi < 0) return empty();
+        const double lo = std::max(a.lo, 0.0);
+        return span({std::pow(lo, p), std::pow(a.hi, p)}, a.lo < 0);
+    }
+    // Over a non-negative base, x^y is monotone in x for each y and in y for each x, so the corners are the extremes
+    if (a.lo < 0) return Interval::entire();
+    return span({std::pow(a.lo, b.lo), std::pow(a.lo, b.hi), std::pow(a.hi, b.lo), std::pow(a.hi, b.hi)}, false);
+}
+
+// Is some offset + 2πk (or + πk with `period` π) inside [lo, hi]? Errs towards yes near the ends.
+bool hitsPeriodic(double lo, double hi, double offset, double period) {
+    const double slack = 1e-12 * std::max({1.0, std::abs(lo), std::abs(hi)});
+    const double k = std::ceil((lo - slack - offset) / period);
+    return offset + k * period <= hi + slack;
+}
+
+Interval sinCos(const Interval& a, bool cosine) {
+    if (isEmpty(a)) return empty();
+    if (unbounded(a)) return exact(-1.0, 1.0, true);
+    if (a.hi - a.lo >= kTwoPi || std::max(std::abs(a.lo), std::abs(a.hi)) > kMaxTrigArg) return exact(-1.0, 1.0, a.nan);
+    auto f = [&](double v) { return cosine ? std::cos(v) : std::sin(v); };
+    Interval r = span({f(a.lo), f(a.hi)}, a.nan);
+    if (hitsPeriodic(a.lo, a.hi, cosine ? 0.0 : M_PI_2, kTwoPi)) r.hi = 1.0;
+    if (hitsPeriodic(a.lo, a.hi, cosine ? M_PI : -M_PI_2, kTwoPi)) r.lo = -1.0;
+    return {std::max(r.lo, -1.0), std::min(r.hi, 1.0), r.nan};
+}
+
+Interval tan(const Interval& a) {
+    if (isEmpty(a)) return empty();
+    if (unbounded(a)) return Interval::entire();
+    if (a.hi - a.lo >= M_PI || std::max(std::abs(a.lo), std::abs(a.hi)) > kMaxTrigArg || hitsPeriodic(a.lo, a.hi, M_PI_2, M_PI))
+        return exact(-kInf, kInf, a.nan);
+    return span({std::tan(a.lo), std::tan(a.hi)}, a.nan);
+}
+
+// √ of a negative or NaN is 0
+Interval sqrt(const Interval& a) {
+    const bool zero = a.nan || isEmpty(a) || a.lo < 0;
+    if (isEmpty(a) || a.hi < 0) return Interval::point(0.0);
+    Interval r = make(std::sqrt(std::max(a.lo, 0.0)), std::sqrt(a.hi), false);
+    if (zero) r.lo = 0.0;
+    return {std::max(r.lo, 0.0), r.hi, false};
+}
+
+// asin/acos are monotone on [−1, 1] and NaN outside it; acos is decreasing
+Interval arcSinCos(const Interval& a, bool cosine) {
+    if (isEmpty(a) || a.hi < -1 || a.lo > 1) return empty();
+    const bool nan = a.nan || a.lo < -1 || a.hi > 1;
+    const double lo = std::max(a.lo, -1.0), hi = std::min(a.hi, 1.0);
+    return cosine ? make(std::acos(hi), std::acos(lo), nan) : make(std::asin(lo), std::asin(hi), nan);
+}
+
+Interval atan(const Interval& a) {
+    if (isEmpty(a)) return empty();
+    return make(std::atan(a.lo), std::atan(a.hi), a.nan); // atan(±∞) = ±π/2
+}
+
+// log of a non-positive or NaN is −∞
+Interval log(const Interval& a, bool base10) {
+    const bool minusInf = a.nan || isEmpty(a) || a.lo <= 0;
+    if (isEmpty(a) || a.hi <= 0) return Interval::point(-kInf);
+    auto f = [&](double v) { return base10 ? std::log10(v) : std::log(v); };
+    Interval r = make(a.lo > 0 ? f(a.lo) : -kInf, f(a.hi), false);
+    if (minusInf) r.lo = -kInf;
+    return r;
+}
+
+// Which truth values a comparison can take; NaN operands compare false
+Interval compare(Token t, const Interval& a, const Interval& b, bool negated) {
+    bool canTrue = false, canFalse = a.nan || b.nan || isEmpty(a) || isEmpty(b);
+    if (!isEmpty(a) && !isEmpty(b)) {
+        // |a − b| < 1e-9 is tested with a rounded subtraction: widen the threshold a little both ways
+        const double nearGap = std::max(a.lo - b.hi, b.lo - a.hi), farGap = std::max(a.hi - b.lo, b.hi - a.lo);
+        const bool canBeNear = nearGap < kTruthy * (1 + 1e-6), canBeFar = farGap > kTruthy * (1 - 1e-6);
+        switch (t) {
+            case Token::Equal: canTrue = canBeNear; canFalse |= canBeFar; break;
+            case Token::NotEqual: canTrue = canBeFar; canFalse |= canBeNear; break;
+            case Token::Less: canTrue = a.lo < b.hi; canFalse |= a.hi >= b.lo; break;
+            case Token::LessEq: canTrue = a.lo <= b.hi; canFalse |= a.hi > b.lo; break;
+            case Token::Greater: canTrue = a.hi > b.lo; canFalse |= a.lo <= b.hi; break;
+            case Token::GreaterEq: canTrue = a.hi >= b.lo; canFalse |= a.lo < b.hi; break;
+            default: return boolean(true, true);
+        }
+    }
+    return negated ? boolean(canFalse, canTrue) : boolean(canTrue, canFalse);
+}
+
+Interval logic(Token t, const Interval& a, const Interval& b) {
+    const bool at = canBeTrue(a), af = canBeFalse(a), bt = canBeTrue(b), bf = canBeFalse(b);
+    switch (t) {
+        case Token::And: return boolean(at && bt, af || bf);
+        case Token::Or: return boolean(at || bt, af && bf);
+        default: return boolean((at && bf) || (af && bt), (at && bt) || (af && bf)); // Xor
+    }
+}
+
+// Scalar programs without registry reads
+bool supported(const Bytecode& code) {
+    if (!code.error.empty() || code.code.empty() || code.usesRegistry || code.resultKind != ValueKind::Scalar) return false;
+    return std::none_of(code.code.begin(), code.code.end(), [](const Instruction& in) { return in.op > OpCode::NotCompare; });
+}
+
+} // namespace
+
+Interval Interval::point(double v) { return {v, v, std::isnan(v)}; }
+Interval Interval::entire() { return {-kInf, kInf, true}; }
+bool Interval::isEntire() const { return lo == -kInf && hi == kInf; }
+bool Interval::isBounded() const { return std::isfinite(lo) && std::isfinite(hi); }
+
+Interval evaluateInterval(const CompiledExpression& expr, Interval x) {
+    const Bytecode& code = expr.bytecode();
+    if (!supported(code)) return Interval::entire();
+
+    // origin[r] names the value in register r, so X·X and a reused CSE slot squared are recognised as squares
+    // (the classic interval dependency problem would otherwise give [−1, 1] for X·X over [−1, 1])
+    Interval inlineRegisters[kInlineRegisters];
+    int inlineOrigins[kInlineRegisters];
+    std::vector<Interval> spilledRegisters;
+    std::vector<int> spilledOrigins;
+    Interval* s = inlineRegisters;
+    int* origin = inlineOrigins;
+    if (code.scalarRegisters > kInlineRegisters) {
+        spilledRegisters.resize(code.scalarRegisters); spilledOrigins.resize(code.scalarRegisters);
+        s = spilledRegisters.data(); origin = spilledOrigins.data();
+    }
+    std::fill_n(origin, code.scalarRegisters, -1);
+    int nextOrigin = 1; // 0 is X
+    for (const Instruction& in : code.code) {
+        const Interval& a = s[in.a];
+        const Interval& b = s[in.b];
+        const bool same = origin[in.a] >= 0 && origin[in.a] == origin[in.b];
+        Interval r;
+        switch (in.op) {
+            case OpCode::Const: r = Interval::point(in.imm); break;
+            case OpCode::LoadX: r = x; break;
+            case OpCode::Move: r = a; break;
+            case OpCode::Sin: r = sinCos(a, false); break;
+            case OpCode::Cos: r = sinCos(a, true); break;
+            case OpCode::Tan: r = tan(a); break;
+            case OpCode::Log: r = log(a, true); break;
+            case OpCode::Ln: r = log(a, false); break;
+            case OpCode::Sqrt: r = sqrt(a); break;
+            case OpCode::ASin: r = arcSinCos(a, false); break;
+            case OpCode::ACos: r = arcSinCos(a, true); break;
+            case OpCode::ATan: r = atan(a); break;
+            case OpCode::Not: r = boolean(canBeFalse(a), canBeTrue(a)); break;
+            case OpCode::Recip: r = recip(a); break;
+            case OpCode::ScalarInverse: r = div(Interval::point(1.0), a); break;
+            case OpCode::Add: r = add(a, b); break;
+            case OpCode::Sub: r = same ? Interval{0.0, 0.0, a.nan || unbounded(a)} : add(a, negate(b)); break;
+            case OpCode::Mul: r = same ? square(a) : mul(a, b); break;
+            case OpCode::Div: r = div(a, b); break;
+            case OpCode::Pow: r = pow(a, b); break;
+            case OpCode::Equal: case OpCode::NotEqual: case OpCode::Less: case OpCode::LessEq:
+            case OpCode::Greater: case OpCode::GreaterEq: r = compare(in.token, a, b, false); break;
+            case OpCode::And: case OpCode::Or: case OpCode::Xor: r = logic(in.token, a, b); break;
+            case OpCode::NotCompare: r = compare(in.token, a, b, true); break;
+            default: return Interval::entire(); // supported() lets no other opcode through
+        }
+        s[in.dst] = r;
+        origin[in.dst] = in.op == OpCode::LoadX ? 0 : in.op == OpCode::Move ? origin[in.a] : nextOrigin++;
+    }
+    return s[code.result];
+}
+
+RangeBound boundRange(const CompiledExpression& expr, double xMin, double xMax, const RangeOptions& options) {
+    TUX_PROFILE_STAGE(Sample);
+    RangeBound out;
+    if (!(xMin <= xMax) || !std::isfinite(xMin) || !std::isfinite(xMax) || !supported(expr.bytecode())) return out;
+
+    double innerLo = kInf, innerHi = -kInf;
+    std::vector<double> probeXs, probeYs;
+    auto probe = [&]() {
+        probeYs.resize(probeXs.size());
+        expr.evaluateBatch(probeXs, probeYs);
+        out.pointEvaluations += probeXs.size();
+        for (double y : probeYs)
+            if (std::isfinite(y)) { innerLo = std::min(innerLo, y); innerHi = std::max(innerHi, y); }
+        probeXs.clear();
+    };
+
+    struct Piece { double a, b; Interval y; };
+    auto enclose = [&](double a, double b) { ++out.intervalEvaluations; return Piece{a, b, evaluateInterval(expr, {a, b, false})}; };
+    std::vector<Piece> pieces{enclose(xMin, xMax)}, next;
+    probeXs = {xMin, 0.5 * (xMin + xMax), xMax};
+    probe();
+
+    // Pieces that can no longer hold a new extreme are settled into this hull
+    Interval settled{kInf, -kInf, false};
+    while (!pieces.empty()) {
+        const bool sampled = innerLo <= innerHi;
+        const double scale = std::max(innerHi - innerLo, 1e-9 * std::max(std::abs(innerLo), std::abs(innerHi)));
+        const double tol = sampled ? options.relativeTolerance * scale : 0.0;
+        next.clear();
+        for (const Piece& p : pieces) {
+            const double m = 0.5 * (p.a + p.b);
+            const bool open = !(p.y.lo >= innerLo - tol && p.y.hi <= innerHi + tol);
+            const bool splittable = m > p.a && m < p.b && out.intervalEvaluations + 2 <= options.maxIntervalEvaluations;
+            if (isEmpty(p.y) || !open || !splittable) { settled = hull(settled, p.y); continue; }
+            next.push_back(enclose(p.a, m));
+            next.push_back(enclose(m, p.b));
+            probeXs.push_back(m);
+        }
+        probe();
+        pieces.swap(next);
+    }
+
+    out.success = innerLo <= innerHi;
+    out.sampledLo = innerLo; out.sampledHi = innerHi;
+    out.lo = settled.lo; out.hi = settled.hi;
+    out.bounded = out.success && settled.isBounded();
+    return out;
+}
+
+} // namespace tux_ti83
@@ -0,0 +1,180 @@
+#include "capsules/capsule_list.hpp"
+#include "capsules/capsule_kernels.hpp"
+#include "capsules/capsule_sampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace tux_ti83 {
+
+namespace {
+
+constexpr size_t kBroadcastBlock = 256; // Scalar operand splatted into an L1-resident column
+
+ParallelSampler& listPool() {
+    static ParallelSampler pool;
+    return pool;
+}
+
+size_t chunkCount(size_t n) { return (n + kListChunk - 1) / kListChunk; }
+
+// fn(chunk, begin, end) over fixed kListChunk ranges; large lists run the chunks on the pool
+template <typename Fn>
+void forChunks(size_t n, Fn&& fn) {
+    const size_t chunks = chunkCount(n);
+    if (n < kListParallelMin) {
+        for (size_t c = 0; c < chunks; ++c) fn(c, c * kListChunk, std::min(n, (c + 1) * kListChunk));
+        return;
+    }
+    listPool().parallelFor(chunks, [&](size_t c) { fn(c, c * kListChunk, std::min(n, (c + 1) * kListChunk)); });
+}
+
+// Four independent accumulators break the add dependency chain without reassociating across chunks
+double chunkSum(const double* p, size_t n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) { s0 += p[i]; s1 += p[i + 1]; s2 += p[i + 2]; s3 += p[i + 3]; }
+    for (; i < n; ++i) s0 += p[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+// Sums fn(begin, end) per chunk, then the partials in chunk order
+template <typename Fn>
+double reduce(size_t n, Fn&& fn) {
+    std::vector<double> partials(chunkCount(n));
+    forChunks(n, [&](size_t c, size_t begin, size_t end) { partials[c] = fn(begin, end); });
+    double total = 0;
+    for (double p : partials) total += p;
+    return total;
+}
+
+bool sortsBefore(double a, double b) { return std::isnan(b) ? !std::isnan(a) : a < b; } // NaN last
+
+} // namespace
+
+List::List(std::vector<double> values) : m_data(std::make_shared<std::vector<double>>(std::move(values))) {}
+
+double* List::mutableData() {
+    if (!m_data) m_data = std::make_shared<std::vector<double>>();
+    else if (m_data.use_count() > 1) m_data = std::make_shared<std::vector<double>>(*m_data);
+    return m_data->data();
+}
+
+void listApply(Token t, List& l) {
+    double* p = l.mutableData();
+    forChunks(l.size(), [&](size_t, size_t begin, size_t end) { applyUnary(t, p + begin, end - begin); });
+}
+
+void listApply(Token t, List& a, const List& b) {
+    double* pa = a.mutableData(); // Detaches when a and b share storage, as in L1+L1
+    const double* pb = b.data();
+    forChunks(a.size(), [&](size_t, size_t begin, size_t end) { applyBinary(t, pa + begin, pb + begin, end - begin); });
+}
+
+void listApply(Token t, List& a, double b) {
+    double* pa = a.mutableData();
+    forChunks(a.size(), [&](size_t, size_t begin, size_t end) {
+        double splat[kBroadcastBlock];
+        std::fill_n(splat, kBroadcastBlock, b);
+        for (size_t i = begin; i < end; i += kBroadcastBlock) applyBinary(t, pa + i, splat, std::min(kBroadcastBlock, end - i));
+    });
+}
+
+void listApply(Token t, double a, List& b) {
+    double* pb = b.mutableData();
+    forChunks(b.size(), [&](size_t, size_t begin, size_t end) {
+        double lhs[kBroadcastBlock];
+        for (size_t i = begin; i < end; i += kBroadcastBlock) {
+            const size_t len = std::min(kBroadcastBlock, end - i);
+            std::fill_n(lhs, len, a);
+            applyBinary(t, lhs, pb + i, len);
+            std::copy_n(lhs, len, pb + i);
+        }
+    });
+}
+
+double listSum(const List& l) {
+    const double* p = l.data();
+    return reduce(l.size(), [&](size_t begin, size_t end) { return chunkSum(p + begin, end - begin); });
+}
+
+double listMean(const List& l) { return l.size() ? listSum(l) / double(l.size()) : std::nan(""); }
+
+double listStdDev(const List& l) {
+    const size_t n = l.size();
+    if (n < 2) return std::nan("");
+    const double mean = listMean(l);
+    const double* p = l.data();
+    const double ss = reduce(n, [&](size_t begin, size_t end) {
+        double s = 0;
+        for (size_t i = begin; i < end; ++i) s += (p[i] - mean) * (p[i] - mean);
+        return s;
+    });
+    return std::sqrt(ss / double(n - 1));
+}
+
+// Chunks are sorted in parallel, then merged pairwise between two buffers, each pass in parallel
+List listSortA(List l) {
+    const size_t n = l.size();
+    double* p = l.mutableData();
+    forChunks(n, [&](size_t, size_t begin, size_t end) { std::sort(p + begin, p + end, sortsBefore); });
+    if (n <= kListChunk) return l;
+
+    std::vector<double> scratch(n);
+    double* from = p;
+    double* to = scratch.data();
+    for (size_t width = kListChunk; width < n; width *= 2) {
+        const size_t pairs = (n + 2 * width - 1) / (2 * width);
+        listPool().parallelFor(pairs, [&](size_t k) {
+            const size_t begin = k * 2 * width, mid = std::min(n, begin + width), end = std::min(n, begin + 2 * width);
+            std::merge(from + begin, from + mid, from + mid, from + end, to + begin, sortsBefore);
+        });
+        std::swap(from, to);
+    }
+    if (from != p) std::copy_n(from, n, p);
+    return l;
+}
+
+// Chunk totals, a serial scan over the totals, then every chunk scanned from its offset
+List listCumSum(List l) {
+    const size_t n = l.size();
+    double* p = l.mutableData();
+    std::vector<double> offsets(chunkCount(n));
+    forChunks(n, [&](size_t c, size_t begin, size_t end) { offsets[c] = chunkSum(p + begin, end - begin); });
+    double running = 0;
+    for (double& o : offsets) { const double total = o; o = running; running += total; }
+    forChunks(n, [&](size_t c, size_t begin, size_t end) {
+        double acc = offsets[c];
+        for (size_t i = begin; i < end; ++i) { acc += p[i]; p[i] = acc; }
+    });
+    return l;
+}
+
+// Centred two-pass sums: no cancellation from Σx² − n·x̄² on large, offset readings
+LinearFit linearRegression(const List& xs, const List& ys) {
+    LinearFit fit;
+    const size_t n = xs.size();
+    if (n < 2 || ys.size() != n) return fit;
+    const double mx = listMean(xs), my = listMean(ys);
+    const double* px = xs.data();
+    const double* py = ys.data();
+    std::vector<double> sxx(chunkCount(n)), sxy(sxx.size()), syy(sxx.size());
+    forChunks(n, [&](size_t c, size_t begin, size_t end) {
+        double xx = 0, xy = 0, yy = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const double dx = px[i] - mx, dy = py[i] - my;
+            xx += dx * dx; xy += dx * dy; yy += dy * dy;
+        }
+        sxx[c] = xx; sxy[c] = xy; syy[c] = yy;
+    });
+    double xx = 0, xy = 0, yy = 0;
+    for (size_t c = 0; c < sxx.size(); ++c) { xx += sxx[c]; xy += sxy[c]; yy += syy[c]; }
+    if (xx == 0) return fit;
+    fit.a = xy / xx;
+    fit.b = my - fit.a * mx;
+    fit.r = yy == 0 ? 0.0 : xy / std::sqrt(xx * yy);
+    fit.success = true;
+    return fit;
+}
+
+} // namespace tux_ti83
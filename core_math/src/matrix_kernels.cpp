@@ -0,0 +1,204 @@
+#include "capsules/capsule_matrix.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace tux_ti83 {
+
+namespace {
+
+constexpr int kBlockI = 64, kBlockK = 64, kBlockJ = 256; // ~128 KiB of B and C per block, sized for L2
+constexpr int kTransposeBlock = 32;
+constexpr size_t kCombineChunk = 512; // Output elements kept in L1 while every term is accumulated
+
+} // namespace
+
+Matrix::Matrix(int r, int c, std::vector<double> values) : rows(r), cols(c) {
+    values.resize(size(), 0.0);
+    m_data = std::make_shared<std::vector<double>>(std::move(values));
+}
+
+double* Matrix::mutableData() {
+    if (!m_data) m_data = std::make_shared<std::vector<double>>(size(), 0.0);
+    else if (m_data.use_count() > 1) m_data = std::make_shared<std::vector<double>>(*m_data);
+    return m_data->data();
+}
+
+Matrix matrixCombine(std::span<const MatrixTerm> terms) {
+    if (terms.empty()) return {};
+    const int r = terms[0].mat.rows, c = terms[0].mat.cols;
+    for (const auto& t : terms) if (t.mat.rows != r || t.mat.cols != c) return {};
+    if (terms.size() == 1 && terms[0].coeff == 1.0) return terms[0].mat; // Shares storage, no allocation
+
+    Matrix res(r, c);
+    double* __restrict out = res.mutableData();
+    const size_t n = res.size();
+    for (size_t base = 0; base < n; base += kCombineChunk) {
+        const size_t end = std::min(base + kCombineChunk, n);
+        const double c0 = terms[0].coeff;
+        const double* __restrict p0 = terms[0].mat.data();
+        for (size_t i = base; i < end; ++i) out[i] = c0 * p0[i];
+        for (size_t t = 1; t < terms.size(); ++t) {
+            const double ct = terms[t].coeff;
+            const double* __restrict pt = terms[t].mat.data();
+            for (size_t i = base; i < end; ++i) out[i] += ct * pt[i];
+        }
+    }
+    return res;
+}
+
+Matrix matrixAdd(const Matrix& a, const Matrix& b) { return matrixAxpby(1.0, a, 1.0, b); }
+
+Matrix matrixAxpby(double alpha, const Matrix& a, double beta, const Matrix& b) {
+    const MatrixTerm terms[] = {{alpha, a}, {beta, b}};
+    return matrixCombine(terms);
+}
+
+Matrix matrixScale(const Matrix& a, double s) {
+    const MatrixTerm terms[] = {{s, a}};
+    return matrixCombine(terms);
+}
+
+Matrix matrixMul(const Matrix& a, const Matrix& b) {
+    if (a.cols != b.rows) return {};
+    Matrix res(a.rows, b.cols);
+    const int n = a.rows, m = a.cols, p = b.cols;
+    const double* A = a.data();
+    const double* B = b.data();
+    double* C = res.mutableData();
+    // i-k-j order inside each block: C and B rows are both walked with unit stride, so the inner loop vectorizes
+    for (int ii = 0; ii < n; ii += kBlockI)
+        for (int kk = 0; kk < m; kk += kBlockK)
+            for (int jj = 0; jj < p; jj += kBlockJ) {
+                const int iEnd = std::min(ii + kBlockI, n), kEnd = std::min(kk + kBlockK, m), jEnd = std::min(jj + kBlockJ, p);
+                for (int i = ii; i < iEnd; ++i) {
+                    double* __restrict c = C + static_cast<size_t>(i) * p;
+                    for (int k = kk; k < kEnd; ++k) {
+                        const double aik = A[static_cast<size_t>(i) * m + k];
+                        const double* __restrict brow = B + static_cast<size_t>(k) * p;
+                        for (int j = jj; j < jEnd; ++j) c[j] += aik * brow[j];
+                    }
+                }
+            }
+    return res;
+}
+
+void matrixTranspose(Matrix& m) {
+    const int r = m.rows, c = m.cols;
+    if (r == c && !m.isShared()) {
+        // Square and unshared: swap blocks across the diagonal without a second buffer
+        double* d = m.mutableData();
+        for (int ib = 0; ib < r; ib += kTransposeBlock)
+            for (int jb = ib; jb < c; jb += kTransposeBlock)
+                for (int i = ib; i < std::min(ib + kTransposeBlock, r); ++i)
+                    for (int j = std::max(jb, i + 1); j < std::min(jb + kTransposeBlock, c); ++j)
+                        std::swap(d[static_cast<size_t>(i) * c + j], d[static_cast<size_t>(j) * c + i]);
+    } else if (r > 1 && c > 1) {
+        // Rectangular or shared: a blocked copy into fresh storage. Following the permutation cycles in place
+        // would need a visited marker per element or a cycle walk per leader, and either costs more than the copy
+        Matrix t(c, r);
+        const double* __restrict s = m.data();
+        double* __restrict d = t.mutableData();
+        for (int ib = 0; ib < r; ib += kTransposeBlock)
+            for (int jb = 0; jb < c; jb += kTransposeBlock)
+                for (int i = ib; i < std::min(ib + kTransposeBlock, r); ++i)
+                    for (int j = jb; j < std::min(jb + kTransposeBlock, c); ++j)
+                        d[static_cast<size_t>(j) * r + i] = s[static_cast<size_t>(i) * c + j];
+        m = std::move(t);
+        return;
+    }
+    std::swap(m.rows, m.cols); // A row or column vector has the same element order either way
+}
+
+LUDecomposition luDecompose(Matrix m) {
+    LUDecomposition res;
+    const int n = m.rows;
+    if (n != m.cols) { res.singular = true; return res; }
+    res.pivots.resize(n);
+    for (int i = 0; i < n; ++i) res.pivots[i] = i;
+
+    double* a = m.mutableData(); // The by-value handle detaches here: the one copy LU needs
+    // Implicit scaling: pivots are compared relative to their own row's largest element, and a pivot counts as zero
+    // only when it is negligible against both its row and its column. A single global scale would call
+    // diag(1e-20, 1e20) singular
+    std::vector<double> rowScale(n, 0.0), colScale(n, 0.0);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+            const double v = std::abs(a[static_cast<size_t>(i) * n + j]);
+            rowScale[i] = std::max(rowScale[i], v);
+            colScale[j] = std::max(colScale[j], v);
+        }
+    const double eps = n * 1e-15;
+
+    for (int k = 0; k < n; ++k) {
+        int p = k;
+        double best = -1.0;
+        for (int i = k; i < n; ++i) {
+            const double v = rowScale[i] > 0.0 ? std::abs(a[static_cast<size_t>(i) * n + k]) / rowScale[i] : 0.0;
+            if (v > best) { best = v; p = i; }
+        }
+        if (p != k) {
+            std::swap_ranges(a + static_cast<size_t>(k) * n, a + static_cast<size_t>(k + 1) * n, a + static_cast<size_t>(p) * n);
+            std::swap(res.pivots[k], res.pivots[p]);
+            std::swap(rowScale[k], rowScale[p]);
+            res.sign = -res.sign;
+        }
+        const double pivot = a[static_cast<size_t>(k) * n + k];
+        if (std::abs(pivot) <= eps * std::min(rowScale[k], colScale[k])) { res.singular = true; continue; }
+        const double* __restrict rowK = a + static_cast<size_t>(k) * n;
+        for (int i = k + 1; i < n; ++i) {
+            double* __restrict rowI = a + static_cast<size_t>(i) * n;
+            const double l = rowI[k] / pivot;
+            rowI[k] = l;
+            for (int j = k + 1; j < n; ++j) rowI[j] -= l * rowK[j];
+        }
+    }
+    res.lu = std::move(m);
+    return res;
+}
+
+double matrixDeterminant(const Matrix& m) {
+    if (m.rows != m.cols || m.rows == 0) return 0.0;
+    LUDecomposition lu = luDecompose(m);
+    if (lu.singular) return 0.0;
+    double det = lu.sign;
+    for (int i = 0; i < m.rows; ++i) det *= lu.lu.at(i, i);
+    return det;
+}
+
+bool matrixInverse(const Matrix& m, Matrix& inverse) {
+    if (m.rows != m.cols || m.rows == 0) return false;
+    LUDecomposition lu = luDecompose(m);
+    if (lu.singular) return false;
+    const int n = m.rows;
+    const double* a = lu.lu.data();
+
+    // Solve LU X = P I with whole-row updates so every inner loop is unit stride
+    Matrix x(n, n);
+    double* X = x.mutableData();
+    for (int k = 0; k < n; ++k) X[static_cast<size_t>(k) * n + lu.pivots[k]] = 1.0;
+    for (int k = 0; k < n; ++k) {
+        const double* __restrict xk = X + static_cast<size_t>(k) * n;
+        for (int i = k + 1; i < n; ++i) {
+            const double l = a[static_cast<size_t>(i) * n + k];
+            if (l == 0.0) continue;
+            double* __restrict xi = X + static_cast<size_t>(i) * n;
+            for (int j = 0; j < n; ++j) xi[j] -= l * xk[j];
+        }
+    }
+    for (int k = n - 1; k >= 0; --k) {
+        double* __restrict xk = X + static_cast<size_t>(k) * n;
+        const double inv = 1.0 / a[static_cast<size_t>(k) * n + k];
+        for (int j = 0; j < n; ++j) xk[j] *= inv;
+        for (int i = 0; i < k; ++i) {
+            const double u = a[static_cast<size_t>(i) * n + k];
+            if (u == 0.0) continue;
+            double* __restrict xi = X + static_cast<size_t>(i) * n;
+            for (int j = 0; j < n; ++j) xi[j] -= u * xk[j];
+        }
+    }
+    inverse = std::move(x);
+    return true;
+}
+
+} // namespace tux_ti83
@@ -0,0 +1,219 @@
+#include "capsules/capsule_optimizer.hpp"
+#include "capsules/capsule_kernels.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace tux_ti83 {
+
+namespace {
+
+bool isComparison(Token t) { return t >= Token::Equal && t <= Token::GreaterEq; }
+bool isCommutative(Token t) {
+    return t == Token::Add || t == Token::Mul || t == Token::Equal || t == Token::NotEqual ||
+           t == Token::And || t == Token::Or || t == Token::Xor;
+}
+bool isMatrixToken(Token t) { return t >= Token::MatA && t <= Token::MatJ; }
+bool isListToken(Token t) { return t >= Token::List1 && t <= Token::List6; }
+// Unary tokens applyUnary() implements, and so the only ones folded or shared
+bool isScalarFunction(Token t) {
+    return (t >= Token::Sin && t <= Token::ATan) || t == Token::Not || t == Token::Inverse || t == Token::Recip;
+}
+
+struct Node {
+    Token op = Token::Num0; // Num0 = constant, VarX, MatA..MatJ, List1..List6, or an operator
+    double value = 0.0;     // Constant, or the comparison Token of a NotCompare
+    int kids[2] = {-1, -1};
+    int arity = 0;
+    bool scalar = true;     // No matrix or list beneath: only these nodes are folded and shared
+    bool boolean = false;   // Always exactly 0 or 1
+};
+
+// Hash-consed expression DAG; every constructor applies the local rewrites before interning
+class DagBuilder {
+public:
+    std::vector<Node> nodes;
+
+    const Node& at(int id) const { return nodes[id]; }
+    bool isConst(int id) const { return nodes[id].op == Token::Num0; }
+    bool isConst(int id, double v) const { return isConst(id) && nodes[id].value == v; }
+
+    int constant(double v) {
+        Node n; n.value = v; n.boolean = (v == 0.0 || v == 1.0);
+        return intern(n);
+    }
+    int leaf(Token t) {
+        Node n; n.op = t; n.scalar = !isMatrixToken(t) && !isListToken(t);
+        return intern(n);
+    }
+
+    int unary(Token t, int a) {
+        const Node& k = nodes[a];
+        if (!k.scalar || !isScalarFunction(t)) return make(t, 0.0, a, -1, 1);
+        if (k.op == Token::Num0) {
+            double v = k.value;
+            applyUnary(t, &v, 1);
+            return constant(v);
+        }
+        if (t == Token::Not) {
+            if (isComparison(k.op)) return binary(Token::NotCompare, k.kids[0], k.kids[1], static_cast<double>(k.op));
+            if (k.op == Token::NotCompare) return binary(static_cast<Token>(static_cast<int>(k.value)), k.kids[0], k.kids[1]);
+            if (k.op == Token::Not && nodes[k.kids[0]].boolean) return k.kids[0];
+        }
+        return make(t, 0.0, a, -1, 1);
+    }
+
+    int binary(Token t, int a, int b, double value = 0.0) {
+        const bool scalar = nodes[a].scalar && nodes[b].scalar;
+        if (!scalar) return make(t, value, a, b, 2);
+        if (isConst(a) && isConst(b)) {
+            double x = nodes[a].value;
+            const double y = nodes[b].value;
+            if (t == Token::NotCompare) applyNotCompare(static_cast<Token>(static_cast<int>(value)), &x, &y, 1);
+            else applyBinary(t, &x, &y, 1);
+            return constant(x);
+        }
+        if (t == Token::Pow && isConst(b)) {
+            const double e = nodes[b].value;
+            if (e == 0.0) return constant(1.0); // pow(x, 0) is 1 even for NaN
+            if (e == 1.0) return a;
+            if (e == 2.0) return binary(Token::Mul, a, a);
+            if (e == 3.0) return binary(Token::Mul, binary(Token::Mul, a, a), a);
+            if (e == 4.0) { int sq = binary(Token::Mul, a, a); return binary(Token::Mul, sq, sq); }
+            if (e == -1.0) return make(Token::Recip, 0.0, a, -1, 1);
+            if (e == -2.0) return make(Token::Recip, 0.0, binary(Token::Mul, a, a), -1, 1);
+        }
+        if (t == Token::Div && isConst(b)) {
+            const double d = nodes[b].value;
+            if (d == 0.0) return constant(0.0); // The evaluator defines x÷0 as 0
+            if (d == 1.0) return a;
+            // Only when 1/c is exact (c a power of two) so x×(1/c) rounds exactly like x÷c
+            int exponent = 0;
+            if (std::isfinite(d) && std::isfinite(1.0 / d) && std::abs(std::frexp(d, &exponent)) == 0.5)
+                return binary(Token::Mul, a, constant(1.0 / d));
+        }
+        if (t == Token::Mul && isConst(a, 1.0)) return b;
+        if (t == Token::Mul && isConst(b, 1.0)) return a;
+        if (t == Token::Sub && isConst(b, 0.0)) return a;
+        if (isCommutative(t) && a > b) std::swap(a, b); // Canonical order so X×2 and 2×X share a node
+        return make(t, value, a, b, 2);
+    }
+
+private:
+    int make(Token t, double value, int a, int b, int arity) {
+        Node n; n.op = t; n.value = value; n.kids[0] = a; n.kids[1] = b; n.arity = arity;
+        n.scalar = nodes[a].scalar && (b < 0 || nodes[b].scalar) && (arity == 2 ? t != Token::LinReg : isScalarFunction(t));
+        n.boolean = isComparison(t) || t == Token::NotCompare || t == Token::Not ||
+                    t == Token::And || t == Token::Or || t == Token::Xor;
+        return intern(n);
+    }
+
+    int intern(const Node& n) {
+        if (!n.scalar) { nodes.push_back(n); return static_cast<int>(nodes.size()) - 1; } // Matrix nodes stay distinct
+        uint64_t bits;
+        std::memcpy(&bits, &n.value, sizeof(bits));
+        auto key = std::make_tuple(static_cast<int>(n.op), bits, n.kids[0], n.kids[1]);
+        auto it = m_interned.find(key);
+        if (it != m_interned.end()) return it->second;
+        nodes.push_back(n);
+        const int id = static_cast<int>(nodes.size()) - 1;
+        m_interned.emplace(key, id);
+        return id;
+    }
+
+    std::map<std::tuple<int, uint64_t, int, int>, int> m_interned;
+};
+
+class Emitter {
+public:
+    Emitter(const DagBuilder& dag, int root) : m_dag(dag), m_uses(dag.nodes.size(), 0), m_slot(dag.nodes.size(), -1) {
+        countUses(root);
+        emit(root);
+    }
+
+    RpnProgram rpn;
+    int slots = 0;
+
+private:
+    void countUses(int id) {
+        if (m_uses[id]++ > 0) return; // Children were counted on the first visit
+        const Node& n = m_dag.at(id);
+        for (int k = 0; k < n.arity; ++k) countUses(n.kids[k]);
+    }
+
+    void emit(int id) {
+        const Node& n = m_dag.at(id);
+        if (n.arity == 0) { rpn.push_back({n.op, n.value}); return; } // Leaves are cheaper to repeat than to reload
+        if (m_slot[id] >= 0) { rpn.push_back({Token::Load, static_cast<double>(m_slot[id])}); return; }
+        for (int k = 0; k < n.arity; ++k) emit(n.kids[k]);
+        rpn.push_back({n.op, n.value});
+        if (m_uses[id] > 1) {
+            m_slot[id] = slots++;
+            rpn.push_back({Token::Store, static_cast<double>(m_slot[id])});
+        }
+    }
+
+    const DagBuilder& m_dag;
+    std::vector<int> m_uses, m_slot;
+};
+
+} // namespace
+
+OptimizedProgram optimizeProgram(const RpnProgram& rpn) {
+    OptimizedProgram unchanged{rpn, 0, false};
+    DagBuilder dag;
+    std::vector<int> stack;
+    for (const auto& [t, value] : rpn) {
+        if (t == Token::Num0) stack.push_back(dag.constant(value));
+        else if (t == Token::Pi) stack.push_back(dag.constant(M_PI));
+        else if (t == Token::E) stack.push_back(dag.constant(M_E));
+        else if (t == Token::VarX || isMatrixToken(t) || isListToken(t)) stack.push_back(dag.leaf(t));
+        else if (t != Token::LinReg && (EOSPrecedence::is_function(t) || EOSPrecedence::is_postfix(t))) {
+            if (stack.empty()) return unchanged;
+            stack.back() = dag.unary(t, stack.back());
+        } else if (is_batch_binary(t) || t == Token::LinReg) {
+            if (stack.size() < 2) return unchanged;
+            const int b = stack.back(); stack.pop_back();
+            stack.back() = dag.binary(t, stack.back(), b);
+        } else {
+            return unchanged; // Tokens the evaluator only tolerates (stray brackets, ImplicitMul...) keep their exact behaviour
+        }
+    }
+    if (stack.size() != 1) return unchanged;
+
+    Emitter emitter(dag, stack.back());
+    return {std::move(emitter.rpn), emitter.slots, true};
+}
+
+std::string disassemble(const RpnProgram& rpn) {
+    static const std::map<Token, const char*> kNames = {
+        {Token::Pi, "pi"}, {Token::E, "e"}, {Token::VarX, "x"},
+        {Token::Add, "add"}, {Token::Sub, "sub"}, {Token::Mul, "mul"}, {Token::Div, "div"}, {Token::Pow, "pow"},
+        {Token::Sin, "sin"}, {Token::Cos, "cos"}, {Token::Tan, "tan"}, {Token::Log, "log"}, {Token::Ln, "ln"},
+        {Token::Sqrt, "sqrt"}, {Token::ASin, "asin"}, {Token::ACos, "acos"}, {Token::ATan, "atan"},
+        {Token::Equal, "eq"}, {Token::NotEqual, "ne"}, {Token::Less, "lt"}, {Token::LessEq, "le"},
+        {Token::Greater, "gt"}, {Token::GreaterEq, "ge"}, {Token::And, "and"}, {Token::Or, "or"},
+        {Token::Xor, "xor"}, {Token::Not, "not"}, {Token::Det, "det"}, {Token::Transpose, "transpose"},
+        {Token::Inverse, "inverse"}, {Token::Recip, "recip"}, {Token::Sum, "sum"}, {Token::Mean, "mean"},
+        {Token::StdDev, "stddev"}, {Token::SortA, "sorta"}, {Token::CumSum, "cumsum"}, {Token::LinReg, "linreg"},
+    };
+    std::string out;
+    char buf[32];
+    for (const auto& [t, value] : rpn) {
+        if (!out.empty()) out += ' ';
+        if (t == Token::Num0) { std::snprintf(buf, sizeof(buf), "%.17g", value); out += buf; }
+        else if (isMatrixToken(t)) { out += '['; out += static_cast<char>('A' + (static_cast<int>(t) - static_cast<int>(Token::MatA))); out += ']'; }
+        else if (isListToken(t)) out += "L" + std::to_string(static_cast<int>(t) - static_cast<int>(Token::List1) + 1);
+        else if (t == Token::Load || t == Token::Store) { out += t == Token::Load ? "load" : "store"; out += std::to_string(static_cast<int>(value)); }
+        else if (t == Token::NotCompare) { out += "not-"; out += kNames.at(static_cast<Token>(static_cast<int>(value))); }
+        else if (auto it = kNames.find(t); it != kNames.end()) out += it->second;
+        else out += "op" + std::to_string(static_cast<int>(t));
+    }
+    return out;
+}
+
+} // namespace tux_ti83
@@ -0,0 +1,139 @@
+#include "capsules/capsule_profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+namespace tux_ti83::profile {
+
+const char* stageName(Stage stage) {
+    static const char* const kNames[] = {"parse", "evaluate", "sample", "box", "layout", "paint"};
+    static_assert(std::size(kNames) == kStageCount);
+    return kNames[static_cast<size_t>(stage)];
+}
+
+const char* counterName(Counter counter) {
+    static const char* const kNames[] = {"evaluations", "allocations", "cacheHits", "cacheMisses", "frames"};
+    static_assert(std::size(kNames) == kCounterCount);
+    return kNames[static_cast<size_t>(counter)];
+}
+
+#if TUX_PROFILE
+
+namespace detail {
+
+Slot stageNs[kStageCount], stageCalls[kStageCount], counters[kCounterCount];
+std::atomic<bool> traceOn{false};
+
+uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace detail
+
+namespace {
+
+struct TraceEvent {
+    Stage stage;
+    uint32_t tid;
+    uint64_t beginNs, endNs;
+};
+
+struct TraceBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    size_t capacity = 0;
+    uint64_t dropped = 0;
+};
+
+TraceBuffer& traceBuffer() {
+    static TraceBuffer buffer;
+    return buffer;
+}
+
+// Small stable ids read better in the trace viewer than hashed std::thread::ids
+uint32_t threadId() {
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+} // namespace
+
+void detail::recordEvent(Stage stage, uint64_t beginNs, uint64_t endNs) {
+    const uint32_t tid = threadId();
+    TraceBuffer& buffer = traceBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() < buffer.capacity) buffer.events.push_back({stage, tid, beginNs, endNs});
+    else ++buffer.dropped;
+}
+
+Snapshot snapshot() {
+    Snapshot s;
+    s.timeNs = detail::nowNs();
+    for (size_t i = 0; i < kStageCount; ++i) {
+        s.stageNs[i] = detail::stageNs[i].value.load(std::memory_order_relaxed);
+        s.stageCalls[i] = detail::stageCalls[i].value.load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kCounterCount; ++i) s.counters[i] = detail::counters[i].value.load(std::memory_order_relaxed);
+    return s;
+}
+
+bool startTrace(size_t maxEvents) {
+    TraceBuffer& buffer = traceBuffer();
+    {
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.events.clear();
+        buffer.events.reserve(std::min<size_t>(maxEvents, 1 << 16));
+        buffer.capacity = maxEvents;
+        buffer.dropped = 0;
+    }
+    detail::traceOn.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool stopTrace() {
+    detail::traceOn.store(false, std::memory_order_relaxed);
+    return true;
+}
+
+bool tracing() { return detail::traceOn.load(std::memory_order_relaxed); }
+
+bool writeTrace(const std::string& path) {
+    std::vector<TraceEvent> events;
+    uint64_t dropped;
+    {
+        TraceBuffer& buffer = traceBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        events = buffer.events;
+        dropped = buffer.dropped;
+    }
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (!out) return false;
+    // Timestamps are microseconds from the first event, so the viewer opens at the start of the capture
+    const uint64_t origin = events.empty() ? 0 : std::min_element(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.beginNs < b.beginNs;
+    })->beginNs;
+    std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":%llu},\"traceEvents\":[", static_cast<unsigned long long>(dropped));
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& e = events[i];
+        std::fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"tux\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", i ? "," : "",
+                     stageName(e.stage), e.tid, double(e.beginNs - origin) / 1000.0, double(e.endNs - e.beginNs) / 1000.0);
+    }
+    std::fprintf(out, "\n]}\n");
+    return std::fclose(out) == 0;
+}
+
+#else
+
+Snapshot snapshot() { return {}; }
+bool startTrace(size_t) { return false; }
+bool stopTrace() { return false; }
+bool tracing() { return false; }
+bool writeTrace(const std::string&) { return false; }
+
+#endif
+
+} // namespace tux_ti83::profile
@@ -0,0 +1,336 @@
+#include "capsules/capsule_sampler.hpp"
+#include "capsules/capsule_profiler.hpp"
+#include "capsules/capsule_interval.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace tux_ti83 {
+
+namespace {
+thread_local bool t_inTask = false; // Set on pool workers, and on a caller while it drains its own parallelFor
+
+// The caller's snapshot, or the current one held in pin for the rest of the call
+const RegistrySnapshot& pinned(const RegistrySnapshot* registry, std::shared_ptr<const RegistrySnapshot>& pin) {
+    if (registry) return *registry;
+    pin = MathStateMachine::registry();
+    return *pin;
+}
+} // namespace
+
+ParallelSampler::ParallelSampler(unsigned threadCount) { startWorkers(threadCount); }
+
+ParallelSampler::~ParallelSampler() { stopWorkers(); }
+
+void ParallelSampler::setThreadCount(unsigned threadCount) {
+    std::lock_guard<std::mutex> call(m_callMutex);
+    stopWorkers();
+    startWorkers(threadCount);
+}
+
+void ParallelSampler::startWorkers(unsigned threadCount) {
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    m_stop = false;
+    for (unsigned i = 1; i < threadCount; ++i) m_workers.emplace_back(&ParallelSampler::workerLoop, this, m_generation);
+}
+
+void ParallelSampler::stopWorkers() {
+    { std::lock_guard<std::mutex> lock(m_mutex); m_stop = true; }
+    m_wake.notify_all();
+    for (auto& w : m_workers) w.join();
+    m_workers.clear();
+}
+
+void ParallelSampler::drain() {
+    for (size_t i = m_next++; i < m_taskCount; i = m_next++) (*m_task)(i);
+}
+
+bool ParallelSampler::inTask() { return t_inTask; }
+
+void ParallelSampler::workerLoop(uint64_t seen) {
+    t_inTask = true;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+        }
+        drain();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_active == 0) m_done.notify_one();
+    }
+}
+
+void ParallelSampler::parallelFor(size_t taskCount, const std::function<void(size_t)>& task) {
+    if (t_inTask) { // Nested: the outer loop already has every core, and m_callMutex could be held by this thread
+        for (size_t i = 0; i < taskCount; ++i) task(i);
+        return;
+    }
+    std::lock_guard<std::mutex> call(m_callMutex);
+    if (m_workers.empty() || taskCount <= 1) {
+        t_inTask = true;
+        for (size_t i = 0; i < taskCount; ++i) task(i);
+        t_inTask = false;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task; m_taskCount = taskCount; m_next = 0;
+        m_active = m_workers.size(); ++m_generation;
+    }
+    m_wake.notify_all();
+    t_inTask = true;
+    drain();
+    t_inTask = false;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&] { return m_active == 0; });
+    m_task = nullptr;
+}
+
+std::vector<SampleSeries> ParallelSampler::sample(const std::vector<const CompiledExpression*>& functions, std::span<const double> xs,
+                                                  const RegistrySnapshot* registry) {
+    TUX_PROFILE_STAGE(Sample);
+    std::shared_ptr<const RegistrySnapshot> pin;
+    const RegistrySnapshot& snapshot = pinned(registry, pin);
+    std::vector<SampleSeries> series(functions.size());
+    for (auto& s : series) s.ys.resize(xs.size());
+    if (functions.empty() || xs.empty()) return series;
+
+    // Roughly four chunks per thread across all functions, but never below kMinChunk samples
+    size_t wanted = std::max<size_t>(1, 4 * threadCount() / functions.size());
+    size_t chunk = std::max(kMinChunk, (xs.size() + wanted - 1) / wanted);
+    size_t chunksPerFn = (xs.size() + chunk - 1) / chunk;
+
+    std::vector<char> ok(functions.size() * chunksPerFn, 0);
+    parallelFor(functions.size() * chunksPerFn, [&](size_t task) {
+        size_t f = task / chunksPerFn, begin = (task % chunksPerFn) * chunk;
+        size_t len = std::min(chunk, xs.size() - begin);
+        ok[task] = functions[f]->evaluateBatch(xs.subspan(begin, len), std::span<double>(series[f].ys).subspan(begin, len), snapshot);
+    });
+
+    // Evaluation errors do not depend on X, so every chunk of a function agrees; require all anyway
+    for (size_t f = 0; f < functions.size(); ++f)
+        series[f].success = std::all_of(ok.begin() + f * chunksPerFn, ok.begin() + (f + 1) * chunksPerFn, [](char c) { return c != 0; });
+    return series;
+}
+
+std::vector<AdaptiveCurve> ParallelSampler::sampleAdaptive(const std::vector<const CompiledExpression*>& functions, const Viewport& vp,
+                                                            double widthPx, double heightPx, const AdaptiveOptions& options, std::stop_token stop,
+                                                            const RegistrySnapshot* registry) {
+    TUX_PROFILE_STAGE(Sample);
+    std::shared_ptr<const RegistrySnapshot> pin;
+    const RegistrySnapshot& snapshot = pinned(registry, pin);
+    std::vector<AdaptiveCurve> curves(functions.size());
+    parallelFor(functions.size(), [&](size_t f) { curves[f] = tux_ti83::sampleAdaptive(*functions[f], vp, widthPx, heightPx, options, stop, &snapshot); });
+    return curves;
+}
+
+const SampleCache::Tile* SampleCache::usable(int xLevel, int yLevel, int64_t index, double visMin, double visMax) {
+    // A tile refined against a finer Y scale is just as good; zoom rarely crosses both levels at once
+    for (int y : {yLevel, yLevel - 1}) {
+        auto it = m_tiles.find({xLevel, y, index});
+        if (it == m_tiles.end() || it->second.cullMin > visMin || it->second.cullMax < visMax) continue;
+        it->second.lastUse = ++m_clock;
+        return &it->second;
+    }
+    return nullptr;
+}
+
+bool SampleCache::resolve(int xLevel, int yLevel, int64_t index, double visMin, double visMax, const Tile* (&tiles)[2]) {
+    tiles[0] = usable(xLevel, yLevel, index, visMin, visMax);
+    tiles[1] = nullptr;
+    if (tiles[0]) return true;
+    // Twice the density is always good enough for the coarser level
+    tiles[0] = usable(xLevel - 1, yLevel, 2 * index, visMin, visMax);
+    tiles[1] = tiles[0] ? usable(xLevel - 1, yLevel, 2 * index + 1, visMin, visMax) : nullptr;
+    return tiles[1] != nullptr;
+}
+
+bool SampleCache::hasTile(int xLevel, int yLevel, int64_t index, double visMin, double visMax) {
+    const Tile* tiles[2];
+    return resolve(xLevel, yLevel, index, visMin, visMax, tiles);
+}
+
+bool SampleCache::appendTile(int xLevel, int yLevel, int64_t index, double visMin, double visMax, AdaptiveCurve& out) {
+    const Tile* tiles[2];
+    if (!resolve(xLevel, yLevel, index, visMin, visMax, tiles)) return false;
+    for (const Tile* tile : tiles) {
+        if (!tile) continue;
+        const AdaptiveCurve& c = tile->curve;
+        if (!c.success) { out.success = false; continue; }
+        size_t first = (!out.xs.empty() && !c.xs.empty() && c.xs.front() <= out.xs.back()) ? 1 : 0; // Shared tile edge
+        out.xs.insert(out.xs.end(), c.xs.begin() + first, c.xs.end());
+        out.ys.insert(out.ys.end(), c.ys.begin() + first, c.ys.end());
+    }
+    return true;
+}
+
+void SampleCache::storeTile(int xLevel, int yLevel, int64_t index, double cullMin, double cullMax, AdaptiveCurve curve) {
+    m_tiles[{xLevel, yLevel, index}] = {std::move(curve), cullMin, cullMax, ++m_clock};
+    while (m_tiles.size() > kMaxTiles) {
+        auto oldest = std::min_element(m_tiles.begin(), m_tiles.end(), [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; });
+        m_tiles.erase(oldest);
+    }
+}
+
+std::vector<AdaptiveCurve> ParallelSampler::sampleCached(const std::vector<const CompiledExpression*>& functions, const std::vector<SampleCache*>& caches,
+                                                         const Viewport& vp, double widthPx, double heightPx, const AdaptiveOptions& options,
+                                                         std::stop_token stop, const RegistrySnapshot* registry) {
+    std::shared_ptr<const RegistrySnapshot> pin;
+    const RegistrySnapshot& snapshot = pinned(registry, pin);
+    const double upx = (vp.xMax - vp.xMin) / widthPx, upy = (vp.yMax - vp.yMin) / heightPx;
+    if (!std::isfinite(upx) || !std::isfinite(upy) || !(upx > 0) || !(upy > 0)) return sampleAdaptive(functions, vp, widthPx, heightPx, options, stop, &snapshot);
+
+    // Quantise both pixel scales down to a power of two; tiles are then at least as dense as the screen
+    const int xLevel = static_cast<int>(std::floor(std::log2(upx))), yLevel = static_cast<int>(std::floor(std::log2(upy)));
+    const double tileWidth = SampleCache::kTilePx * std::ldexp(1.0, xLevel), uy = std::ldexp(1.0, yLevel);
+    const double firstTile = std::floor(vp.xMin / tileWidth), lastTile = std::floor(vp.xMax / tileWidth);
+    if (!(std::abs(firstTile) < 1e15 && std::abs(lastTile) < 1e15) || lastTile - firstTile > 64) return sampleAdaptive(functions, vp, widthPx, heightPx, options, stop, &snapshot);
+    const int64_t first = static_cast<int64_t>(firstTile), count = static_cast<int64_t>(lastTile - firstTile) + 1;
+
+    TUX_PROFILE_STAGE(Sample); // After the fallbacks, which time themselves
+    // New tiles refine against two view heights of margin, so small vertical pans keep hitting the cache
+    const double span = vp.yMax - vp.yMin, cullMin = vp.yMin - 2 * span, cullMax = vp.yMax + 2 * span;
+
+    std::vector<AdaptiveCurve> curves(functions.size());
+    struct Missing { size_t f; int64_t k; AdaptiveCurve curve; };
+    std::vector<Missing> missing;
+    for (size_t f = 0; f < functions.size(); ++f)
+        for (int64_t k = first; k < first + count; ++k)
+            if (!caches[f]->hasTile(xLevel, yLevel, k, vp.yMin, vp.yMax)) missing.push_back({f, k, {}});
+    TUX_PROFILE_COUNT(CacheMisses, missing.size());
+    TUX_PROFILE_COUNT(CacheHits, functions.size() * static_cast<size_t>(count) - missing.size());
+
+    parallelFor(missing.size(), [&](size_t i) {
+        Missing& m = missing[i];
+        Viewport tile{m.k * tileWidth, (m.k + 1) * tileWidth, cullMin, cullMax};
+        m.curve.cancelled = true;
+        if (!stop.stop_requested()) m.curve = tux_ti83::sampleAdaptive(*functions[m.f], tile, SampleCache::kTilePx, (cullMax - cullMin) / uy, options, stop, &snapshot);
+    });
+    for (auto& m : missing) {
+        curves[m.f].evaluations += m.curve.evaluations;
+        if (!m.curve.cancelled) caches[m.f]->storeTile(xLevel, yLevel, m.k, cullMin, cullMax, std::move(m.curve));
+    }
+    if (stop.stop_requested()) {
+        for (auto& c : curves) c.cancelled = true;
+        return curves;
+    }
+
+    for (size_t f = 0; f < functions.size(); ++f) {
+        AdaptiveCurve stitched;
+        stitched.success = true;
+        for (int64_t k = first; k < first + count; ++k) caches[f]->appendTile(xLevel, yLevel, k, vp.yMin, vp.yMax, stitched);
+
+        // Trim to the viewport, keeping one sample either side so the curve reaches the edges
+        auto lo = std::lower_bound(stitched.xs.begin(), stitched.xs.end(), vp.xMin);
+        auto hi = std::upper_bound(stitched.xs.begin(), stitched.xs.end(), vp.xMax);
+        size_t b = static_cast<size_t>(std::max<std::ptrdiff_t>(0, lo - stitched.xs.begin() - 1));
+        size_t e = static_cast<size_t>(std::min<std::ptrdiff_t>(stitched.xs.size(), hi - stitched.xs.begin() + 1));
+        curves[f].xs.assign(stitched.xs.begin() + b, stitched.xs.begin() + e);
+        curves[f].ys.assign(stitched.ys.begin() + b, stitched.ys.begin() + e);
+        curves[f].success = stitched.success && !stitched.xs.empty();
+    }
+    return curves;
+}
+
+namespace {
+constexpr double kSpikeRatio = 4.0; // Enclosure overshoot per pixel of sampled rise before a segment counts as suspect
+constexpr size_t kIntervalChecksPerSegment = 3; // Interval evaluations per coarse segment, should the overshoot not shrink
+} // namespace
+
+AdaptiveCurve sampleAdaptive(const CompiledExpression& expr, const Viewport& vp, double widthPx, double heightPx, const AdaptiveOptions& options,
+                             std::stop_token stop, const RegistrySnapshot* registry) {
+    AdaptiveCurve curve;
+    if (!(widthPx > 0) || !(heightPx > 0) || !(vp.xMax > vp.xMin) || !(vp.yMax > vp.yMin)) return curve;
+    std::shared_ptr<const RegistrySnapshot> pin;
+    const RegistrySnapshot& snapshot = pinned(registry, pin);
+    const double sy = heightPx / (vp.yMax - vp.yMin), tol = options.pixelTolerance;
+
+    const size_t n0 = std::max<size_t>(16, static_cast<size_t>(std::ceil(widthPx / options.initialSpacingPx)));
+    std::vector<double> xs(n0 + 1), ys(n0 + 1);
+    for (size_t i = 0; i <= n0; ++i) xs[i] = vp.xMin + i * (vp.xMax - vp.xMin) / n0;
+    if (!expr.evaluateBatch(xs, ys, snapshot)) return curve;
+    curve.evaluations = xs.size();
+
+    // suspect: no enclosure has cleared this segment yet. Each coarse segment is checked once; only the halves
+    // of a segment whose enclosure overshoots its samples are checked again, so a smooth curve costs one
+    // interval evaluation per coarse segment however finely it is refined, and no curve costs more than the budget.
+    struct Segment { size_t l, r; int depth; bool brk, suspect; };
+    std::vector<Segment> active, next, done;
+    for (size_t i = 0; i < n0; ++i) active.push_back({i, i + 1, 0, false, options.intervalGuard});
+
+    std::vector<double> mx, my;
+    size_t intervalChecks = kIntervalChecksPerSegment * n0;
+    while (!active.empty()) {
+        if (stop.stop_requested()) { curve.cancelled = true; return curve; }
+        mx.resize(active.size()); my.resize(active.size());
+        for (size_t k = 0; k < active.size(); ++k) mx[k] = 0.5 * (xs[active[k].l] + xs[active[k].r]);
+        expr.evaluateBatch(mx, my, snapshot);
+        curve.evaluations += mx.size();
+
+        next.clear();
+        for (size_t k = 0; k < active.size(); ++k) {
+            const Segment seg = active[k];
+            const size_t m = xs.size();
+            xs.push_back(mx[k]); ys.push_back(my[k]);
+            const double yl = ys[seg.l], yr = ys[seg.r], ym = my[k];
+            const int finiteCount = std::isfinite(yl) + std::isfinite(ym) + std::isfinite(yr);
+
+            bool refine = false, suspect = false;
+            if (finiteCount == 3) {
+                bool above = yl > vp.yMax && ym > vp.yMax && yr > vp.yMax;
+                bool below = yl < vp.yMin && ym < vp.yMin && yr < vp.yMin;
+                refine = !above && !below && std::abs(ym - 0.5 * (yl + yr)) * sy > tol;
+                if (seg.suspect && intervalChecks > 0) {
+                    // A flat or off-screen chord can still hide a spike that reaches into view between the samples.
+                    // Enclosures of smooth curves overshoot in proportion to the rise across the segment (the
+                    // dependency problem), so only an overshoot well beyond that rise counts as a spike.
+                    --intervalChecks;
+                    const Interval y = evaluateInterval(expr, {xs[seg.l], xs[seg.r]});
+                    const double lo = std::max(y.lo, vp.yMin), hi = std::min(y.hi, vp.yMax);
+                    const double sLo = std::clamp(std::min({yl, ym, yr}), vp.yMin, vp.yMax), sHi = std::clamp(std::max({yl, ym, yr}), vp.yMin, vp.yMax);
+                    const double rise = (std::max({yl, ym, yr}) - std::min({yl, ym, yr})) * sy;
+                    suspect = !y.isEntire() && lo <= hi && std::max(sLo - lo, hi - sHi) * sy > tol + kSpikeRatio * rise;
+                    refine |= suspect;
+                }
+            } else if (finiteCount > 0) {
+                // Narrow down where the curve enters or leaves its domain, unless it provably stays off-screen
+                const bool check = options.intervalGuard && intervalChecks > 0;
+                intervalChecks -= check;
+                const Interval y = check ? evaluateInterval(expr, {xs[seg.l], xs[seg.r]}) : Interval::entire();
+                refine = y.lo <= vp.yMax && y.hi >= vp.yMin;
+                suspect = options.intervalGuard; // Whatever finite part the halves keep has not been checked yet
+            }
+
+            if (refine && seg.depth < options.maxDepth) {
+                next.push_back({seg.l, m, seg.depth + 1, false, suspect});
+                next.push_back({m, seg.r, seg.depth + 1, false, suspect});
+                continue;
+            }
+
+            // Still bending at full depth: a continuous curve splits its rise between both halves,
+            // a jump or asymptote concentrates it in one
+            bool brkLeft = false, brkRight = false;
+            if (refine && finiteCount == 3) {
+                const double a = std::abs(ym - yl) * sy, b = std::abs(yr - ym) * sy;
+                if (a + b > tol && (a + b > heightPx || std::max(a, b) >= 0.95 * (a + b))) (a > b ? brkLeft : brkRight) = true;
+            }
+            done.push_back({seg.l, m, seg.depth, brkLeft, false});
+            done.push_back({m, seg.r, seg.depth, brkRight, false});
+        }
+        active.swap(next);
+    }
+    curve.intervalEvaluations = kIntervalChecksPerSegment * n0 - intervalChecks;
+
+    std::sort(done.begin(), done.end(), [&](const Segment& a, const Segment& b) { return xs[a.l] < xs[b.l]; });
+    curve.xs.reserve(done.size() + 1); curve.ys.reserve(done.size() + 1);
+    curve.xs.push_back(xs[done.front().l]); curve.ys.push_back(ys[done.front().l]);
+    for (const auto& seg : done) {
+        if (seg.brk) { curve.xs.push_back(0.5 * (xs[seg.l] + xs[seg.r])); curve.ys.push_back(std::nan("")); }
+        curve.xs.push_back(xs[seg.r]); curve.ys.push_back(ys[seg.r]);
+    }
+    curve.success = true;
+    return curve;
+}
+
+} // namespace tux_ti83
@@ -0,0 +1,329 @@
+#include "capsules/capsule_session.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace tux_ti83 {
+
+namespace {
+
+// The last magic byte is the format version; '1' stored raw Token ordinals and is refused rather than misread
+constexpr char kFormatVersion = '2';
+constexpr char kMagic[8] = {'T', 'U', 'X', 'S', 'E', 'S', 'S', kFormatVersion};
+
+// Tokens are stored as their index in this table, not as enum ordinals, so Token can be reordered or grown
+// without breaking saved sessions. Append new tokens at the end; never reorder or reuse an id. The
+// optimizer-only Load, Store, Recip and NotCompare are absent and so can never be saved or replayed.
+constexpr Token kTokenIds[] = {
+    Token::Num0, Token::Num1, Token::Num2, Token::Num3, Token::Num4, Token::Num5, Token::Num6, Token::Num7, Token::Num8, Token::Num9,
+    Token::Decimal, Token::Pi, Token::E, Token::Add, Token::Sub, Token::Mul, Token::Div, Token::Pow, Token::ImplicitMul,
+    Token::Sin, Token::Cos, Token::Tan, Token::Log, Token::Ln, Token::Sqrt, Token::ASin, Token::ACos, Token::ATan,
+    Token::Equal, Token::NotEqual, Token::Less, Token::LessEq, Token::Greater, Token::GreaterEq,
+    Token::And, Token::Or, Token::Xor, Token::Not,
+    Token::LeftParen, Token::RightParen, Token::VarX,
+    Token::OpenBracket, Token::CloseBracket, Token::Comma,
+    Token::MatA, Token::MatB, Token::MatC, Token::MatD, Token::MatE, Token::MatF, Token::MatG, Token::MatH, Token::MatI, Token::MatJ,
+    Token::Det, Token::Transpose, Token::Inverse,
+    Token::List1, Token::List2, Token::List3, Token::List4, Token::List5, Token::List6,
+    Token::Sum, Token::Mean, Token::StdDev, Token::SortA, Token::CumSum, Token::LinReg,
+};
+constexpr uint8_t kNoId = 0xFF;
+static_assert(std::size(kTokenIds) < kNoId, "token ids are stored as one byte");
+
+// Token ordinal → id, kNoId for tokens that are never stored
+constexpr auto kIdOfToken = [] {
+    std::array<uint8_t, static_cast<size_t>(Token::NotCompare) + 1> ids{};
+    ids.fill(kNoId);
+    for (size_t i = 0; i < std::size(kTokenIds); ++i) ids[static_cast<size_t>(kTokenIds[i])] = static_cast<uint8_t>(i);
+    return ids;
+}();
+
+uint8_t tokenId(Token t) { return kIdOfToken[static_cast<size_t>(t)]; }
+bool storable(Token t) { return tokenId(t) != kNoId; }
+bool tokenFromId(uint8_t id, Token& t) {
+    if (id >= std::size(kTokenIds)) return false;
+    t = kTokenIds[id];
+    return true;
+}
+
+enum class RecordType : uint8_t { Function = 1, Matrix, List, History };
+
+// Native byte order: a session file is local state, not an interchange format
+struct RecordHeader {
+    uint32_t size;     // Payload bytes after this header
+    uint32_t checksum; // FNV-1a of type, key and payload
+    uint8_t type, key;
+    uint16_t zero;
+};
+static_assert(sizeof(RecordHeader) == 12);
+
+uint32_t fnv1a(const void* data, size_t bytes, uint32_t h = 2166136261u) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+uint32_t checksum(uint8_t type, uint8_t key, const void* head, size_t headBytes, const void* body, size_t bodyBytes) {
+    const uint8_t tk[2] = {type, key};
+    return fnv1a(body, bodyBytes, fnv1a(head, headBytes, fnv1a(tk, 2)));
+}
+
+bool writeAll(int fd, iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = ::writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        for (; count > 0 && static_cast<size_t>(n) >= iov->iov_len; --count, ++iov) n -= static_cast<ssize_t>(iov->iov_len);
+        if (count > 0) { iov->iov_base = static_cast<char*>(iov->iov_base) + n; iov->iov_len -= static_cast<size_t>(n); }
+    }
+    return true;
+}
+
+// One writev per record, so the record is whole unless the process dies inside the call. Returns the bytes
+// written, 0 on failure.
+uint64_t writeRecord(int fd, RecordType type, uint8_t key, const void* head, size_t headBytes, const void* body, size_t bodyBytes) {
+    if (headBytes + bodyBytes > UINT32_MAX) return 0;
+    const auto t = static_cast<uint8_t>(type);
+    RecordHeader h{static_cast<uint32_t>(headBytes + bodyBytes), checksum(t, key, head, headBytes, body, bodyBytes), t, key, 0};
+    iovec iov[3] = {{&h, sizeof h}, {const_cast<void*>(head), headBytes}, {const_cast<void*>(body), bodyBytes}};
+    return writeAll(fd, iov, 3) ? sizeof h + headBytes + bodyBytes : 0;
+}
+
+uint64_t writeFunction(int fd, size_t slot, const std::vector<Token>& tokens, const std::string& display) {
+    std::string payload(4, '\0');
+    const auto count = static_cast<uint32_t>(tokens.size());
+    std::memcpy(payload.data(), &count, 4);
+    for (Token t : tokens) payload += static_cast<char>(tokenId(t));
+    payload += display;
+    return writeRecord(fd, RecordType::Function, static_cast<uint8_t>(slot), payload.data(), payload.size(), nullptr, 0);
+}
+
+uint64_t writeMatrix(int fd, Token name, const Matrix& m) {
+    const int32_t dims[2] = {m.rows, m.cols};
+    return writeRecord(fd, RecordType::Matrix, tokenId(name), dims, sizeof dims, m.data(), m.size() * sizeof(double));
+}
+
+uint64_t writeList(int fd, Token name, const List& l) {
+    return writeRecord(fd, RecordType::List, tokenId(name), nullptr, 0, l.data(), l.size() * sizeof(double));
+}
+
+uint64_t writeHistory(int fd, std::string_view entry) {
+    return writeRecord(fd, RecordType::History, 0, entry.data(), entry.size(), nullptr, 0);
+}
+
+std::vector<double> doublesAt(const char* p, size_t bytes) {
+    std::vector<double> values(bytes / sizeof(double));
+    if (!values.empty()) std::memcpy(values.data(), p, values.size() * sizeof(double)); // The mapping need not be 8-byte aligned here
+    return values;
+}
+
+// Decodes one record into state; malformed payloads are skipped rather than failing the whole session
+void apply(SessionState& state, const RecordHeader& h, const char* p) {
+    switch (static_cast<RecordType>(h.type)) {
+        case RecordType::Function: {
+            uint32_t count;
+            if (h.size < 4) return;
+            std::memcpy(&count, p, 4);
+            if (count > h.size - 4) return;
+            std::vector<Token> tokens;
+            for (uint32_t i = 0; i < count; ++i) {
+                Token t;
+                if (!tokenFromId(static_cast<uint8_t>(p[4 + i]), t)) return;
+                tokens.push_back(t);
+            }
+            if (state.functions.size() <= h.key) { state.functions.resize(h.key + 1u); state.displays.resize(h.key + 1u); }
+            state.functions[h.key] = std::move(tokens);
+            state.displays[h.key].assign(p + 4 + count, h.size - 4 - count);
+            break;
+        }
+        case RecordType::Matrix: {
+            Token name;
+            int32_t dims[2];
+            if (!tokenFromId(h.key, name) || name < Token::MatA || name > Token::MatJ || h.size < sizeof dims) return;
+            std::memcpy(dims, p, sizeof dims);
+            if (dims[0] < 0 || dims[1] < 0 || uint64_t(dims[0]) * uint64_t(dims[1]) * sizeof(double) != h.size - sizeof dims) return;
+            state.matrices[name] = Matrix(dims[0], dims[1], doublesAt(p + sizeof dims, h.size - sizeof dims));
+            break;
+        }
+        case RecordType::List: {
+            Token name;
+            if (!tokenFromId(h.key, name) || name < Token::List1 || name > Token::List6 || h.size % sizeof(double) != 0) return;
+            state.lists[name] = List(doublesAt(p, h.size));
+            break;
+        }
+        case RecordType::History: state.history.push({p, h.size}); break;
+    }
+}
+
+} // namespace
+
+HistoryRing::HistoryRing(size_t capacity) : m_bytes(capacity * kMaxEntryBytes), m_lengths(capacity, 0) {}
+
+void HistoryRing::push(std::string_view entry) {
+    if (m_lengths.empty()) return;
+    static constexpr std::string_view kEllipsis = "…";
+    std::string_view kept = entry, tail;
+    if (entry.size() > kMaxEntryBytes) {
+        size_t cut = kMaxEntryBytes - kEllipsis.size();
+        while (cut > 0 && (static_cast<unsigned char>(entry[cut]) & 0xC0) == 0x80) --cut; // Not inside a code point
+        kept = entry.substr(0, cut); tail = kEllipsis;
+    }
+    char* slot = m_bytes.data() + m_next * kMaxEntryBytes;
+    std::copy(kept.begin(), kept.end(), slot);
+    std::copy(tail.begin(), tail.end(), slot + kept.size());
+    m_lengths[m_next] = static_cast<uint16_t>(kept.size() + tail.size());
+    m_next = (m_next + 1) % m_lengths.size();
+    m_size = std::min(m_size + 1, m_lengths.size());
+}
+
+std::string_view HistoryRing::operator[](size_t i) const {
+    const size_t slot = (m_next + m_lengths.size() - 1 - i) % m_lengths.size();
+    return {m_bytes.data() + slot * kMaxEntryBytes, m_lengths[slot]};
+}
+
+SessionLog::~SessionLog() { close(); }
+
+void SessionLog::close() {
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+}
+
+bool SessionLog::open(const std::string& path, std::string& error) {
+    close();
+    m_state = SessionState{};
+    m_path = path;
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) { error = path + ": " + std::strerror(errno); return false; }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) { error = path + ": " + std::strerror(errno); ::close(fd); return false; }
+    const auto size = static_cast<uint64_t>(st.st_size);
+    if (size == 0) {
+        if (::write(fd, kMagic, sizeof kMagic) != static_cast<ssize_t>(sizeof kMagic)) { error = path + ": " + std::strerror(errno); ::close(fd); return false; }
+        m_fd = fd; m_logBytes = sizeof kMagic;
+        return true;
+    }
+
+    void* map = size >= sizeof kMagic ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED || std::memcmp(map, kMagic, sizeof kMagic) != 0) {
+        const bool otherVersion = map != MAP_FAILED && std::memcmp(map, kMagic, sizeof kMagic - 1) == 0;
+        if (map != MAP_FAILED) ::munmap(map, size);
+        error = path + (otherVersion ? ": session format from another tux_ti83 version" : ": not a tux_ti83 session file");
+        ::close(fd);
+        return false;
+    }
+    const char* base = static_cast<const char*>(map);
+    auto headerAt = [&](uint64_t off) { RecordHeader h; std::memcpy(&h, base + off, sizeof h); return h; };
+
+    // Header walk: the newest record per (type, key) and the newest history records, as offsets into the map
+    std::map<std::pair<uint8_t, uint8_t>, uint64_t> latest;
+    std::vector<uint64_t> history;
+    uint64_t end = sizeof kMagic, last = 0;
+    auto walk = [&](uint64_t limit) {
+        latest.clear(); history.clear();
+        uint64_t off = sizeof kMagic;
+        while (off + sizeof(RecordHeader) <= limit) {
+            const RecordHeader h = headerAt(off);
+            if (off + sizeof h + h.size > limit || h.zero != 0) break;
+            if (h.type == static_cast<uint8_t>(RecordType::History)) history.push_back(off);
+            else latest[{h.type, h.key}] = off;
+            last = off;
+            off += sizeof h + h.size;
+        }
+        end = off;
+    };
+    walk(size);
+    // Only the final record can be torn: verify it and drop it if its payload never fully landed
+    if (end > sizeof kMagic) {
+        const RecordHeader h = headerAt(last);
+        if (checksum(h.type, h.key, base + last + sizeof h, h.size, nullptr, 0) != h.checksum) walk(last);
+    }
+
+    for (const auto& [key, off] : latest) apply(m_state, headerAt(off), base + off + sizeof(RecordHeader));
+    const size_t keep = std::min(history.size(), m_state.history.capacity());
+    for (size_t i = history.size() - keep; i < history.size(); ++i) apply(m_state, headerAt(history[i]), base + history[i] + sizeof(RecordHeader));
+    ::munmap(map, size);
+
+    if (end < size && ::ftruncate(fd, static_cast<off_t>(end)) != 0) { error = path + ": " + std::strerror(errno); ::close(fd); return false; }
+    m_fd = fd; m_logBytes = end;
+    maybeCompact();
+    return true;
+}
+
+bool SessionLog::commit(uint64_t written) {
+    if (written == 0) {
+        if (::ftruncate(m_fd, static_cast<off_t>(m_logBytes)) != 0) close(); // Cut a partial record, or stop writing
+        return false;
+    }
+    m_logBytes += written;
+    maybeCompact();
+    return true;
+}
+
+bool SessionLog::saveFunction(size_t slot, const std::vector<Token>& tokens, const std::string& display) {
+    if (slot > UINT8_MAX || !std::all_of(tokens.begin(), tokens.end(), storable)) return false;
+    if (m_state.functions.size() <= slot) { m_state.functions.resize(slot + 1); m_state.displays.resize(slot + 1); }
+    if (m_state.functions[slot] == tokens && m_state.displays[slot] == display) return isOpen(); // Nothing new to log
+    m_state.functions[slot] = tokens; m_state.displays[slot] = display;
+    return isOpen() && commit(writeFunction(m_fd, slot, tokens, display));
+}
+
+bool SessionLog::saveMatrix(Token name, const Matrix& value) {
+    if (name < Token::MatA || name > Token::MatJ) return false;
+    m_state.matrices[name] = value; // Shares the caller's storage
+    return isOpen() && commit(writeMatrix(m_fd, name, value));
+}
+
+bool SessionLog::saveList(Token name, const List& value) {
+    if (name < Token::List1 || name > Token::List6) return false;
+    m_state.lists[name] = value;
+    return isOpen() && commit(writeList(m_fd, name, value));
+}
+
+bool SessionLog::saveHistory(std::string_view entry) {
+    m_state.history.push(entry);
+    return isOpen() && commit(writeHistory(m_fd, m_state.history[0])); // As truncated by the ring
+}
+
+uint64_t SessionLog::liveBytes() const {
+    uint64_t bytes = sizeof kMagic;
+    for (size_t f = 0; f < m_state.functions.size(); ++f) bytes += sizeof(RecordHeader) + 4 + m_state.functions[f].size() + m_state.displays[f].size();
+    for (const auto& [name, m] : m_state.matrices) bytes += sizeof(RecordHeader) + 8 + m.size() * sizeof(double);
+    for (const auto& [name, l] : m_state.lists) bytes += sizeof(RecordHeader) + l.size() * sizeof(double);
+    for (size_t i = 0; i < m_state.history.size(); ++i) bytes += sizeof(RecordHeader) + m_state.history[i].size();
+    return bytes;
+}
+
+void SessionLog::maybeCompact() {
+    if (m_logBytes > kCompactMinBytes && m_logBytes > kCompactRatio * liveBytes()) compact();
+}
+
+// Writes the live state to a sibling file and renames it over the log, so a crash leaves one or the other
+bool SessionLog::compact() {
+    if (m_fd < 0) return false;
+    const std::string tmp = m_path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = ::write(fd, kMagic, sizeof kMagic) == static_cast<ssize_t>(sizeof kMagic);
+    for (size_t f = 0; ok && f < m_state.functions.size(); ++f) ok = writeFunction(fd, f, m_state.functions[f], m_state.displays[f]);
+    for (auto it = m_state.matrices.begin(); ok && it != m_state.matrices.end(); ++it) ok = writeMatrix(fd, it->first, it->second);
+    for (auto it = m_state.lists.begin(); ok && it != m_state.lists.end(); ++it) ok = writeList(fd, it->first, it->second);
+    for (size_t i = m_state.history.size(); ok && i-- > 0;) ok = writeHistory(fd, m_state.history[i]); // Oldest first
+    struct stat st;
+    ok = ok && ::fsync(fd) == 0 && ::fstat(fd, &st) == 0;
+    ::close(fd);
+    if (!ok || std::rename(tmp.c_str(), m_path.c_str()) != 0) { std::remove(tmp.c_str()); return false; }
+    const int log = ::open(m_path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    close();
+    m_fd = log;
+    m_logBytes = static_cast<uint64_t>(st.st_size);
+    return m_fd >= 0;
+}
+
+} // namespace tux_ti83
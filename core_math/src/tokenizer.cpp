@@ -0,0 +1,214 @@
+#include "capsules/capsule_tokenizer.hpp"
+#include <cctype>
+#include <utility>
+
+namespace tux_ti83 {
+
+namespace {
+
+struct Spelling { std::string_view text; Token token; };
+
+// Longest spellings first so "asin" wins over "a…", "<=" over "<" and "xor" over "x"
+constexpr Spelling kFunctions[] = {
+    {"asin", Token::ASin}, {"acos", Token::ACos}, {"atan", Token::ATan}, {"sqrt", Token::Sqrt},
+    {"sin", Token::Sin}, {"cos", Token::Cos}, {"tan", Token::Tan}, {"log", Token::Log},
+    {"det", Token::Det}, {"not", Token::Not}, {"ln", Token::Ln},
+    {"stddev", Token::StdDev}, {"cumsum", Token::CumSum}, {"linreg", Token::LinReg}, {"sorta", Token::SortA},
+    {"mean", Token::Mean}, {"sum", Token::Sum},
+};
+constexpr Spelling kWordOperators[] = {{"and", Token::And}, {"xor", Token::Xor}, {"or", Token::Or}};
+constexpr Spelling kWordOperands[] = {{"pi", Token::Pi}, {"x", Token::VarX}, {"e", Token::E}};
+constexpr Spelling kSymbols[] = {
+    {"<=", Token::LessEq}, {">=", Token::GreaterEq}, {"!=", Token::NotEqual}, {"==", Token::Equal}, {"**", Token::Pow},
+    {"≤", Token::LessEq}, {"≥", Token::GreaterEq}, {"≠", Token::NotEqual}, {"×", Token::Mul}, {"÷", Token::Div},
+    {"+", Token::Add}, {"*", Token::Mul}, {"/", Token::Div}, {"^", Token::Pow}, {"=", Token::Equal},
+    {"<", Token::Less}, {">", Token::Greater},
+};
+
+bool startsWithWord(std::string_view text, std::string_view word) {
+    if (text.size() < word.size()) return false;
+    for (size_t i = 0; i < word.size(); ++i)
+        if (std::tolower(static_cast<unsigned char>(text[i])) != word[i]) return false;
+    return true;
+}
+
+class Tokenizer {
+public:
+    explicit Tokenizer(std::string_view text) : m_text(text) {}
+
+    TokenizeResult run() {
+        while (m_pos < m_text.size() && m_result.error_message.empty()) step();
+        if (!m_result.error_message.empty()) return std::move(m_result);
+        if (!m_operandEnded) return fail(m_text.size(), m_out.empty() ? "Empty" : "Expected operand");
+        while (m_depth > 0) { closeNegations(); m_out.push_back(Token::RightParen); --m_depth; } // Implied ")" as on the keypad
+        closeNegations();
+        m_result.success = true;
+        m_result.tokens = std::move(m_out);
+        return std::move(m_result);
+    }
+
+private:
+    void step() {
+        std::string_view rest = m_text.substr(m_pos);
+        const unsigned char c = static_cast<unsigned char>(rest[0]);
+        if (std::isspace(c)) { ++m_pos; return; }
+        if (std::isdigit(c) || c == '.') { number(); return; }
+        if (std::isalpha(c)) { word(); return; }
+        if (c == '[') { matrix(); return; }
+        if (c == ',') {
+            if (m_depth == 0) { fail(m_pos, "Unexpected ,"); return; }
+            binary(Token::Comma, 1); // Argument separator of LinReg(
+            return;
+        }
+        if (c == '(') { beginOperand(); m_out.push_back(Token::LeftParen); ++m_depth; ++m_pos; return; }
+        if (c == ')') {
+            if (m_depth == 0) { fail(m_pos, "Unmatched )"); return; }
+            if (!m_operandEnded) { fail(m_pos, "Expected operand"); return; }
+            closeNegations(); m_out.push_back(Token::RightParen); --m_depth; ++m_pos; return;
+        }
+        if (rest.starts_with("⁻¹")) { postfix(Token::Inverse, sizeof("⁻¹") - 1); return; }
+        if (rest.starts_with("ᵀ")) { postfix(Token::Transpose, sizeof("ᵀ") - 1); return; }
+        if (c == '\'') { postfix(Token::Transpose, 1); return; }
+        if (rest.starts_with("²")) {
+            if (postfix(Token::Pow, sizeof("²") - 1)) m_out.push_back(Token::Num2);
+            return;
+        }
+        if (rest.starts_with("π")) { operand(Token::Pi, sizeof("π") - 1); return; }
+        if (rest.starts_with("√")) { function(Token::Sqrt, sizeof("√") - 1); return; }
+        if (c == '-' || rest.starts_with("−")) { minus(c == '-' ? 1 : sizeof("−") - 1); return; }
+        for (const auto& s : kSymbols)
+            if (rest.starts_with(s.text)) {
+                if (s.token == Token::Add && !m_operandEnded) { m_pos += s.text.size(); return; } // Unary plus
+                binary(s.token, s.text.size());
+                return;
+            }
+        fail(m_pos, "Unexpected character");
+    }
+
+    // Digits and '.', with an optional exponent ("1.5e-3") spelled out as ×10^(…) since the keypad has no ᴇ token
+    void number() {
+        beginOperand();
+        size_t i = m_pos;
+        bool dot = false;
+        for (; i < m_text.size() && (std::isdigit(static_cast<unsigned char>(m_text[i])) || m_text[i] == '.'); ++i) {
+            if (m_text[i] == '.') {
+                if (dot) { fail(i, "Malformed number"); return; }
+                dot = true;
+            }
+            m_out.push_back(m_text[i] == '.' ? Token::Decimal : static_cast<Token>(m_text[i] - '0'));
+        }
+        if (i == m_pos + 1 && dot) { fail(m_pos, "Malformed number"); return; }
+        size_t e = i;
+        if (e < m_text.size() && (m_text[e] == 'e' || m_text[e] == 'E')) {
+            size_t d = e + 1;
+            const bool negative = d < m_text.size() && m_text[d] == '-';
+            if (d < m_text.size() && (m_text[d] == '-' || m_text[d] == '+')) ++d;
+            if (d < m_text.size() && std::isdigit(static_cast<unsigned char>(m_text[d]))) {
+                m_out.insert(m_out.end() - static_cast<long>(i - m_pos), Token::LeftParen);
+                m_out.insert(m_out.end(), {Token::Mul, Token::Num1, Token::Num0, Token::Pow, Token::LeftParen});
+                if (negative) m_out.insert(m_out.end(), {Token::Num0, Token::Sub});
+                for (; d < m_text.size() && std::isdigit(static_cast<unsigned char>(m_text[d])); ++d) m_out.push_back(static_cast<Token>(m_text[d] - '0'));
+                m_out.insert(m_out.end(), {Token::RightParen, Token::RightParen});
+                i = d;
+            }
+        }
+        m_pos = i;
+        m_operandEnded = true;
+    }
+
+    void word() {
+        std::string_view rest = m_text.substr(m_pos);
+        if ((rest[0] == 'l' || rest[0] == 'L') && rest.size() > 1 && rest[1] >= '1' && rest[1] <= '6') {
+            operand(static_cast<Token>(static_cast<int>(Token::List1) + (rest[1] - '1')), 2);
+            return;
+        }
+        for (const auto& s : kFunctions)
+            if (startsWithWord(rest, s.text)) { function(s.token, s.text.size()); return; }
+        for (const auto& s : kWordOperators)
+            if (startsWithWord(rest, s.text)) { binary(s.token, s.text.size()); return; }
+        for (const auto& s : kWordOperands)
+            if (startsWithWord(rest, s.text)) { operand(s.token, s.text.size()); return; }
+        fail(m_pos, "Unknown name");
+    }
+
+    void matrix() {
+        if (m_pos + 2 >= m_text.size() || m_text[m_pos + 2] != ']') { fail(m_pos, "Expected [A] through [J]"); return; }
+        const char name = static_cast<char>(std::toupper(static_cast<unsigned char>(m_text[m_pos + 1])));
+        if (name < 'A' || name > 'J') { fail(m_pos, "Expected [A] through [J]"); return; }
+        operand(static_cast<Token>(static_cast<int>(Token::MatA) + (name - 'A')), 3);
+    }
+
+    // A function name must open its argument list: "sin(" becomes Sin, LeftParen
+    void function(Token t, size_t length) {
+        size_t p = m_pos + length;
+        while (p < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[p]))) ++p;
+        if (p >= m_text.size() || m_text[p] != '(') { fail(m_pos, "Expected ( after function"); return; }
+        beginOperand();
+        m_out.push_back(t); m_out.push_back(Token::LeftParen);
+        ++m_depth;
+        m_pos = p + 1;
+    }
+
+    void operand(Token t, size_t length) {
+        beginOperand();
+        m_out.push_back(t);
+        m_pos += length;
+        m_operandEnded = true;
+    }
+
+    bool postfix(Token t, size_t length) {
+        if (!m_operandEnded) { fail(m_pos, "Expected operand"); return false; }
+        m_out.push_back(t);
+        m_pos += length;
+        return true;
+    }
+
+    void binary(Token t, size_t length) {
+        if (!m_operandEnded) { fail(m_pos, "Expected operand"); return; }
+        if (t != Token::Pow) closeNegations(); // ^ stays inside a pending negation: −X^2 = −(X^2)
+        m_out.push_back(t);
+        m_pos += length;
+        m_operandEnded = false;
+    }
+
+    void minus(size_t length) {
+        if (m_operandEnded) { binary(Token::Sub, length); return; }
+        m_out.insert(m_out.end(), {Token::LeftParen, Token::Num0, Token::Sub});
+        m_negations.push_back(m_depth);
+        m_pos += length;
+    }
+
+    // Juxtaposed operands ("2X", ")(") multiply, which also ends any negation open at this depth
+    void beginOperand() {
+        if (!m_operandEnded) return;
+        closeNegations();
+        m_out.push_back(Token::Mul);
+        m_operandEnded = false;
+    }
+
+    void closeNegations() {
+        while (!m_negations.empty() && m_negations.back() == m_depth) { m_out.push_back(Token::RightParen); m_negations.pop_back(); }
+    }
+
+    TokenizeResult fail(size_t offset, const char* message) {
+        m_result.success = false;
+        m_result.error_message = message;
+        m_result.errorOffset = offset;
+        m_result.tokens.clear();
+        return m_result;
+    }
+
+    std::string_view m_text;
+    size_t m_pos = 0;
+    int m_depth = 0;
+    bool m_operandEnded = false;
+    std::vector<int> m_negations; // Paren depth of each open (0−…) wrapper
+    std::vector<Token> m_out;
+    TokenizeResult m_result;
+};
+
+} // namespace
+
+TokenizeResult tokenize(std::string_view text) { return Tokenizer(text).run(); }
+
+} // namespace tux_ti83
@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <functional>
+#include <cstdint>
+#include "capsules/capsule_sampler.hpp"
+
+namespace tux_ti83 {
+
+struct GraphRequest {
+    uint64_t id = 0;
+    Viewport vp{};
+    double widthPx = 0, heightPx = 0;
+    std::vector<CompiledExpression> functions; // Private copies, safe to evaluate off the GUI thread
+    std::vector<size_t> slots;                 // Y buffer index of each function
+    std::vector<uint64_t> versions;            // Buffer version of each function, drives cache invalidation
+    // Matrices and lists as of the post: every sample of the frame reads this snapshot, and its version also
+    // invalidates the caches of functions that read them
+    std::shared_ptr<const RegistrySnapshot> registry;
+};
+
+struct GraphFrame {
+    uint64_t id = 0;
+    Viewport vp{};
+    std::vector<AdaptiveCurve> curves; // World-space samples, one per requested function
+};
+
+// Single background thread that turns the latest GraphRequest into a GraphFrame. post() replaces any
+// request still waiting and cancels the one being sampled, so bursts of pan/zoom events collapse into
+// one pass. The per-slot SampleCaches and the sampler pool live here and are only touched by the worker,
+// so GUI-thread sampling on another pool never waits behind a frame.
+class GraphPipeline {
+public:
+    using FrameCallback = std::function<void(std::shared_ptr<const GraphFrame>)>; // Runs on the worker thread
+
+    GraphPipeline(unsigned threadCount, FrameCallback onFrame); // threadCount as for ParallelSampler
+    ~GraphPipeline();
+    GraphPipeline(const GraphPipeline&) = delete;
+    GraphPipeline& operator=(const GraphPipeline&) = delete;
+
+    void post(GraphRequest request);
+    void setThreadCount(unsigned threadCount); // Applied by the worker before its next frame
+
+private:
+    struct SlotCache {
+        uint64_t version = 0, registryVersion = 0;
+        SampleCache cache;
+    };
+    void run();
+
+    ParallelSampler m_sampler;
+    FrameCallback m_onFrame;
+    std::map<size_t, SlotCache> m_caches;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::optional<GraphRequest> m_pending;
+    std::optional<unsigned> m_pendingThreads;
+    std::stop_source m_inFlight;
+    bool m_quit = false;
+    std::thread m_worker; // Last, so it starts after every member above is constructed
+};
+
+} // namespace tux_ti83
@@ -0,0 +1,58 @@
+#pragma once
+#include <QQuickItem>
+#include <QList>
+#include <QPointer>
+#include <QSGGeometry>
+#include <memory>
+#include <vector>
+#include "ui_controller.hpp"
+
+namespace tux_ti83 {
+
+// Pixel-space line segments (two vertices per segment) handed to the scene graph as packed floats
+struct PlotLayer {
+    QColor color;
+    float lineWidth = 1.0f;
+    std::vector<QSGGeometry::Point2D> segments;
+};
+
+// Scene-graph plot of the controller's Y functions. Frames published by the
+// controller's background pipeline are converted straight into vertex buffers
+// in updatePolish(); labels are left to QML through xTicks/yTicks.
+class GraphPlotItem : public QQuickItem {
+    Q_OBJECT
+    Q_PROPERTY(tux_ti83::UIController* controller READ controller WRITE setController NOTIFY controllerChanged)
+    Q_PROPERTY(QList<qreal> xTicks READ xTicks NOTIFY ticksChanged)
+    Q_PROPERTY(QList<qreal> yTicks READ yTicks NOTIFY ticksChanged)
+
+public:
+    explicit GraphPlotItem(QQuickItem* parent = nullptr);
+
+    UIController* controller() const { return m_controller; }
+    void setController(UIController* controller);
+    QList<qreal> xTicks() const { return m_xTicks; }
+    QList<qreal> yTicks() const { return m_yTicks; }
+
+signals:
+    void controllerChanged();
+    void ticksChanged();
+
+protected:
+    void updatePolish() override;
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+
+private:
+    void rebuildGrid(std::vector<PlotLayer>& layers, const Viewport& vp, float w, float h);
+    void rebuildCurves(std::vector<PlotLayer>& layers, const Viewport& vp, float w, float h);
+
+    QPointer<UIController> m_controller;
+    QList<qreal> m_xTicks, m_yTicks;
+    // [0] grid, [1] axes, [2..] curves. Published layers are never written again: the software paint node shares
+    // them instead of copying, and polish builds into m_spare, the set before, once no node holds it
+    std::shared_ptr<std::vector<PlotLayer>> m_layers = std::make_shared<std::vector<PlotLayer>>();
+    std::shared_ptr<std::vector<PlotLayer>> m_spare;
+    bool m_layersDirty = true;
+};
+
+} // namespace tux_ti83
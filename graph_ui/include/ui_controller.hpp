@@ -2,8 +2,17 @@
 #include <QObject>
 #include <QStringList>
 #include <QVariantList>
+#include <QTimer>
+#include <array>
 #include <vector>
+#include <optional>
+#include <memory>
+#include <cstdint>
 #include "capsules/capsule_math.hpp"
+#include "capsules/capsule_sampler.hpp"
+#include "capsules/capsule_profiler.hpp"
+#include "capsules/capsule_session.hpp"
+#include "graph_pipeline.hpp"
 
 namespace tux_ti83 {
 
@@ -17,13 +26,51 @@ class UIController : public QObject {
     Q_PROPERTY(QStringList history READ history NOTIFY historyChanged)
     Q_PROPERTY(int activeFunctionIndex READ activeFunctionIndex NOTIFY activeFunctionIndexChanged)
     Q_PROPERTY(bool isGraphMode MEMBER m_isGraphMode NOTIFY graphModeChanged)
+    Q_PROPERTY(int samplerThreads READ samplerThreads WRITE setSamplerThreads NOTIFY samplerThreadsChanged)
+    // Instrumentation (capsule_profiler.hpp): figures refresh twice a second while perfOverlay is on.
+    // Stage times are milliseconds per plot frame over the last interval.
+    Q_PROPERTY(bool profilingAvailable READ profilingAvailable CONSTANT)
+    Q_PROPERTY(bool perfOverlay READ perfOverlay WRITE setPerfOverlay NOTIFY perfOverlayChanged)
+    Q_PROPERTY(bool tracing READ tracing WRITE setTracing NOTIFY tracingChanged)
+    Q_PROPERTY(double framesPerSecond READ framesPerSecond NOTIFY perfChanged)
+    Q_PROPERTY(double parseMs READ parseMs NOTIFY perfChanged)
+    Q_PROPERTY(double sampleMs READ sampleMs NOTIFY perfChanged)
+    Q_PROPERTY(double boxMs READ boxMs NOTIFY perfChanged)
+    Q_PROPERTY(double layoutMs READ layoutMs NOTIFY perfChanged)
+    Q_PROPERTY(double paintMs READ paintMs NOTIFY perfChanged)
+    Q_PROPERTY(double evaluationsPerFrame READ evaluationsPerFrame NOTIFY perfChanged)
+    Q_PROPERTY(double allocationsPerFrame READ allocationsPerFrame NOTIFY perfChanged)
+    Q_PROPERTY(double cacheHitRate READ cacheHitRate NOTIFY perfChanged)
 
 public:
     explicit UIController(QObject* parent = nullptr);
 
     QString currentDisplay() const;
-    QStringList history() const { return m_history; }
+    QStringList history() const;
     int activeFunctionIndex() const { return m_activeIdx; }
+    int samplerThreads() const { return static_cast<int>(m_sampler.threadCount()); }
+    void setSamplerThreads(int threads); // 0 = all cores, 1 = deterministic single-thread sampling
+    Viewport viewport() const { return {m_xMin, m_xMax, m_yMin, m_yMax}; }
+
+    bool profilingAvailable() const { return profile::kEnabled; }
+    bool perfOverlay() const { return m_perfTimer.isActive(); }
+    void setPerfOverlay(bool on);
+    bool tracing() const { return profile::tracing(); }
+    void setTracing(bool on);
+    double framesPerSecond() const { return m_perf.framesPerSecond; }
+    double parseMs() const { return stageMs(profile::Stage::Parse); }
+    double sampleMs() const { return stageMs(profile::Stage::Sample); }
+    double boxMs() const { return stageMs(profile::Stage::Box); }
+    double layoutMs() const { return stageMs(profile::Stage::Layout); }
+    double paintMs() const { return stageMs(profile::Stage::Paint); }
+    double evaluationsPerFrame() const { return m_perf.evaluationsPerFrame; }
+    double allocationsPerFrame() const { return m_perf.allocationsPerFrame; }
+    double cacheHitRate() const { return m_perf.cacheHitRate; }
+
+    // Asynchronous graph path for GraphPlotItem: the plot reports its pixel size, every viewport or function
+    // change posts a request to the background pipeline, and graphReady() announces each finished frame
+    void setPlotSize(double widthPx, double heightPx);
+    std::shared_ptr<const GraphFrame> latestGraph() const { return m_graph; }
 
     Q_INVOKABLE void processInput(const QString& input);
     Q_INVOKABLE void setActiveFunction(int index) { m_activeIdx = index; emit activeFunctionIndexChanged(); }
@@ -31,9 +78,13 @@ public:
     Q_INVOKABLE void resetViewport() { m_xMin = -10; m_xMax = 10; m_yMin = -10; m_yMax = 10; emit viewportChanged(); }
     Q_INVOKABLE void zoomFit();
     Q_INVOKABLE void updateMatrix(const QString& name, int rows, int cols, const QVariantList& values);
+    Q_INVOKABLE void updateList(const QString& name, const QVariantList& values);
     Q_INVOKABLE QVariantList getMultiGraphPoints(int resolution);
     Q_INVOKABLE void pan(double dx, double dy, double vw, double vh);
     Q_INVOKABLE void zoom(double f, double mx, double my, double vw, double vh);
+    Q_INVOKABLE bool writeTrace(const QString& path); // Chrome trace-event JSON of the current capture
+    // Restores Y buffers, matrices, lists and history from the session log at path, then appends every edit to it
+    Q_INVOKABLE bool openSession(const QString& path);
 
 signals:
     void displayChanged();
@@ -41,14 +92,44 @@ signals:
     void activeFunctionIndexChanged();
     void viewportChanged();
     void graphModeChanged();
+    void samplerThreadsChanged();
+    void functionsChanged();
+    void graphReady();
+    void perfOverlayChanged();
+    void tracingChanged();
+    void perfChanged();
 
 private:
+    const CompiledExpression& compiledFunction(size_t index);
+    void invalidateFunction(size_t index);
+    std::vector<const CompiledExpression*> activeFunctions();
+    void requestGraph();
+    void publishGraph(std::shared_ptr<const GraphFrame> frame);
+    void refreshPerf();
+    void saveFunction(size_t index) { m_session.saveFunction(index, m_functionBuffers[index], m_displayStrings[index].toStdString()); }
+    double stageMs(profile::Stage stage) const { return m_perf.stageMs[static_cast<size_t>(stage)]; }
+
+    struct PerfFigures {
+        double framesPerSecond = 0, evaluationsPerFrame = 0, allocationsPerFrame = 0, cacheHitRate = 0;
+        std::array<double, profile::kStageCount> stageMs{};
+    };
+
     std::vector<std::vector<Token>> m_functionBuffers;
+    std::vector<std::optional<CompiledExpression>> m_compiledFunctions; // Reset whenever the matching buffer changes
+    std::vector<uint64_t> m_functionVersions;                          // Bumped with the buffer
     std::vector<QString> m_displayStrings;
-    QStringList m_history;
+    SessionLog m_session; // Also holds the history ring when no session file is open
     int m_activeIdx;
     bool m_isGraphMode = false;
     double m_xMin = -10, m_xMax = 10, m_yMin = -10, m_yMax = 10;
+    ParallelSampler m_sampler; // GUI-thread sampling: zoomFit() and getMultiGraphPoints()
+    double m_plotWidth = 0, m_plotHeight = 0;
+    uint64_t m_nextGraphId = 1;
+    std::shared_ptr<const GraphFrame> m_graph;
+    QTimer m_perfTimer;
+    profile::Snapshot m_perfLast;
+    PerfFigures m_perf;
+    GraphPipeline m_pipeline; // Samples frames on its own pool; last, so its worker is joined before the members above go
 };
 
 } // namespace tux_ti83
@@ -1,6 +1,7 @@
 import QtQuick
 import QtQuick.Controls
 import QtQuick.Layouts
+import TuxTI83
 
 ApplicationWindow {
     visible: true
@@ -9,6 +10,20 @@ ApplicationWindow {
     title: "Tux-TI83"
     color: "#2E3440"
 
+    Shortcut {
+        sequence: "F3"
+        enabled: uiController.profilingAvailable
+        onActivated: uiController.perfOverlay = !uiController.perfOverlay
+    }
+    Shortcut {
+        sequence: "F4"
+        enabled: uiController.profilingAvailable
+        onActivated: {
+            if (uiController.tracing) { uiController.tracing = false; uiController.writeTrace("tux-trace.json") }
+            else uiController.tracing = true
+        }
+    }
+
     // MATRIX POPUP
     Popup {
         id: matrixPopup
@@ -43,6 +58,18 @@ ApplicationWindow {
                     }
                     background: Rectangle { color: namesTab.checked ? "#88C0D0" : "#2E3440" }
                 }
+                TabButton { 
+                    id: mathTab
+                    text: "MATH"
+                    contentItem: Text { 
+                        text: mathTab.text
+                        color: mathTab.checked ? "#2E3440" : "#D8DEE9"
+                        horizontalAlignment: Text.AlignHCenter
+                        verticalAlignment: Text.AlignVCenter
+                        font.bold: true 
+                    }
+                    background: Rectangle { color: mathTab.checked ? "#88C0D0" : "#2E3440" }
+                }
                 TabButton { 
                     id: editTab
                     text: "EDIT"
@@ -88,6 +115,31 @@ ApplicationWindow {
                     }
                 }
                 
+                ColumnLayout {
+                    ListView {
+                        Layout.fillWidth: true
+                        Layout.fillHeight: true
+                        model: [{ label: "det(", input: "det" }, { label: "ᵀ", input: "ᵀ" }, { label: "⁻¹", input: "⁻¹" }]
+                        delegate: ItemDelegate { 
+                            id: mathDelegate
+                            width: parent.width
+                            height: 45
+                            background: Rectangle { color: mathDelegate.hovered ? "#4C566A" : "transparent"; radius: 4 }
+                            contentItem: Text { 
+                                text: modelData.label
+                                color: "#88C0D0"
+                                font.pixelSize: 20
+                                font.bold: true
+                                verticalAlignment: Text.AlignVCenter 
+                            }
+                            onClicked: {
+                                uiController.processInput(modelData.input)
+                                matrixPopup.close()
+                            }
+                        }
+                    }
+                }
+                
                 ColumnLayout {
                     spacing: 10
                     Text { text: "Edit Matrix [A] (3x3)"; color: "#88C0D0"; font.bold: true; font.pixelSize: 16 }
@@ -253,6 +305,75 @@ ApplicationWindow {
         }
     }
 
+    // LIST POPUP
+    Popup {
+        id: listPopup
+        width: 300
+        height: 380
+        modal: true
+        focus: true
+        x: (workspacePane.width - width) / 2
+        y: (workspacePane.height - height) / 2
+        background: Rectangle { 
+            color: "#88C0D0"
+            radius: 8
+            border.color: "#ECEFF4"
+            border.width: 3 
+        }
+        ColumnLayout {
+            anchors.fill: parent
+            anchors.margins: 10
+            spacing: 5
+            GridLayout {
+                columns: 3
+                Layout.fillWidth: true
+                Repeater {
+                    model: ["L1", "L2", "L3", "L4", "L5", "L6", "sum", "mean", "stdDev", "SortA", "cumSum", "LinReg", ","]
+                    delegate: Button {
+                        id: listBtn
+                        Layout.fillWidth: true
+                        text: modelData
+                        background: Rectangle { 
+                            color: listBtn.pressed ? "#2E3440" : (listBtn.hovered ? "#4C566A" : "#3B4252")
+                            radius: 4 
+                        }
+                        contentItem: Text { 
+                            text: modelData
+                            color: "#ECEFF4"
+                            font.bold: true
+                            horizontalAlignment: Text.AlignHCenter
+                            verticalAlignment: Text.AlignVCenter 
+                        }
+                        onClicked: {
+                            uiController.processInput(text)
+                            listPopup.close()
+                        }
+                    }
+                }
+            }
+            Text { text: "Store list (e.g. L1=1,2,3)"; color: "#2E3440"; font.bold: true }
+            RowLayout {
+                Layout.fillWidth: true
+                TextField { id: listEntry; Layout.fillWidth: true; placeholderText: "L1=1,2,3" }
+                Button {
+                    text: "STO"
+                    onClicked: {
+                        var parts = listEntry.text.split("=")
+                        if (parts.length !== 2) return
+                        var vals = []
+                        var items = parts[1].split(",")
+                        for (var i = 0; i < items.length; i++) {
+                            var v = parseFloat(items[i])
+                            if (!isNaN(v)) vals.push(v)
+                        }
+                        uiController.updateList(parts[0].trim().toUpperCase(), vals)
+                        listPopup.close()
+                    }
+                }
+            }
+        }
+    }
+
     RowLayout {
         anchors.fill: parent
         spacing: 0
@@ -319,24 +440,25 @@ ApplicationWindow {
                         rowSpacing: 8
                         columnSpacing: 8
                         Repeater {
-                            model: ["7","8","9","÷","sin","asin","4","5","6","×","cos","acos","1","2","3","−","tan","atan","0",".","MATRX","+","√","^","X","log","ln","(","LOGIC",")","DEL","C","ENTER"]
+                            model: ["7","8","9","÷","sin","asin","4","5","6","×","cos","acos","1","2","3","−","tan","atan","0",".","MATRX","+","√","^","X","log","ln","(","LOGIC",")","LIST","DEL","C","ENTER"]
                             delegate: Rectangle {
                                 Layout.fillWidth: true
                                 Layout.fillHeight: true
                                 radius: 6
-                                Layout.columnSpan: modelData === "ENTER" ? 4 : 1
-                                color: (modelData === "ENTER") ? "#88C0D0" : (modelData === "DEL" || modelData === "C") ? "#BF616A" : (modelData === "X") ? "#A3BE8C" : (modelData === "LOGIC" || modelData === "MATRX") ? "#EBCB8B" : (["sin","cos","tan","asin","acos","atan","√","log","ln","^"].indexOf(modelData) !== -1) ? "#B48EAD" : "#4C566A"
+                                Layout.columnSpan: modelData === "ENTER" ? 3 : 1
+                                color: (modelData === "ENTER") ? "#88C0D0" : (modelData === "DEL" || modelData === "C") ? "#BF616A" : (modelData === "X") ? "#A3BE8C" : (modelData === "LOGIC" || modelData === "MATRX" || modelData === "LIST") ? "#EBCB8B" : (["sin","cos","tan","asin","acos","atan","√","log","ln","^"].indexOf(modelData) !== -1) ? "#B48EAD" : "#4C566A"
                                 Text { 
                                     anchors.centerIn: parent
                                     text: modelData
                                     font.bold: true
-                                    color: (["ENTER","X","LOGIC","MATRX","sin","cos","tan","asin","acos","atan","√","log","ln","^"].indexOf(modelData) !== -1) ? "#2E3440" : "#ECEFF4" 
+                                    color: (["ENTER","X","LOGIC","MATRX","LIST","sin","cos","tan","asin","acos","atan","√","log","ln","^"].indexOf(modelData) !== -1) ? "#2E3440" : "#ECEFF4" 
                                 }
                                 MouseArea { 
                                     anchors.fill: parent
                                     onClicked: { 
                                         if (modelData === "LOGIC") logicPopup.open()
                                         else if (modelData === "MATRX") matrixPopup.open()
+                                        else if (modelData === "LIST") listPopup.open()
                                         else uiController.processInput(modelData) 
                                     }
                                 }
@@ -348,55 +470,35 @@ ApplicationWindow {
                         color: "#1A1D23"
                         radius: 6
                         clip: true
-                        Canvas {
-                            id: graphCanvas
+                        GraphPlot {
+                            id: graphPlot
                             anchors.fill: parent
-                            onPaint: {
-                                var ctx = getContext("2d")
-                                ctx.clearRect(0, 0, width, height)
-                                function toPx(x, y) { return { x: (x - uiController.xMin) * (width / (uiController.xMax - uiController.xMin)), y: height - (y - uiController.yMin) * (height / (uiController.yMax - uiController.yMin)) }; }
-                                
-                                var rangeX = uiController.xMax - uiController.xMin
-                                var step = rangeX > 50 ? 10 : (rangeX < 5 ? 0.5 : 1)
-                                ctx.font = "10px sans-serif"
-                                ctx.fillStyle = "#4C566A"
+                            controller: uiController
 
-                                // Grid Lines & Labels
-                                for (var x = Math.floor(uiController.xMin / step) * step; x <= uiController.xMax; x += step) {
-                                    var px = toPx(x, 0)
-                                    ctx.strokeStyle = (Math.abs(x) < 0.0001) ? "#D8DEE9" : "#2E3440"
-                                    ctx.beginPath()
-                                    ctx.moveTo(px.x, 0)
-                                    ctx.lineTo(px.x, height)
-                                    ctx.stroke()
-                                    if (Math.abs(x) > 0.0001) ctx.fillText(x.toFixed(1), px.x + 2, height - 5)
+                            // Axis Labels
+                            Repeater {
+                                model: graphPlot.xTicks
+                                delegate: Text {
+                                    visible: Math.abs(modelData) > 0.0001
+                                    x: (modelData - uiController.xMin) * (graphPlot.width / (uiController.xMax - uiController.xMin)) + 2
+                                    y: graphPlot.height - 5 - height
+                                    text: modelData.toFixed(1)
+                                    color: "#4C566A"
+                                    font.pixelSize: 10
                                 }
-                                for (var y = Math.floor(uiController.yMin / step) * step; y <= uiController.yMax; y += step) {
-                                    var py = toPx(0, y)
-                                    ctx.strokeStyle = (Math.abs(y) < 0.0001) ? "#D8DEE9" : "#2E3440"
-                                    ctx.beginPath()
-                                    ctx.moveTo(0, py.y)
-                                    ctx.lineTo(width, py.y)
-                                    ctx.stroke()
-                                    if (Math.abs(y) > 0.0001) ctx.fillText(y.toFixed(1), 5, py.y - 2)
-                                }
-
-                                // Function Lines
-                                var colors = ["#88C0D0", "#BF616A", "#A3BE8C"]
-                                var multiPts = uiController.getMultiGraphPoints(600)
-                                for (var f=0; f < multiPts.length; f++) {
-                                    var pts = multiPts[f]
-                                    ctx.beginPath()
-                                    ctx.strokeStyle = colors[f % colors.length]
-                                    ctx.lineWidth = 2.5
-                                    for (var i=0; i < pts.length; i++) { 
-                                        var pt = toPx(pts[i].x, pts[i].y)
-                                        if (i === 0) ctx.moveTo(pt.x, pt.y); else ctx.lineTo(pt.x, pt.y)
-                                    }
-                                    ctx.stroke()
+                            }
+                            Repeater {
+                                model: graphPlot.yTicks
+                                delegate: Text {
+                                    visible: Math.abs(modelData) > 0.0001
+                                    x: 5
+                                    y: graphPlot.height - (modelData - uiController.yMin) * (graphPlot.height / (uiController.yMax - uiController.yMin)) - 2 - height
+                                    text: modelData.toFixed(1)
+                                    color: "#4C566A"
+                                    font.pixelSize: 10
                                 }
                             }
-                            
+
                             MouseArea {
                                 anchors.fill: parent
                                 property real lastX
@@ -416,10 +518,33 @@ ApplicationWindow {
                                     uiController.zoom(wheel.angleDelta.y > 0 ? 0.9 : 1.1, wheel.x, wheel.y, width, height) 
                                 }
                             }
+                        }
 
-                            Connections { 
-                                target: uiController
-                                function onViewportChanged() { graphCanvas.requestPaint() } 
+                        // PERFORMANCE OVERLAY (F3); F4 toggles trace capture and writes tux-trace.json
+                        Rectangle {
+                            visible: uiController.perfOverlay
+                            anchors.top: parent.top
+                            anchors.right: parent.right
+                            anchors.margins: 8
+                            width: perfText.implicitWidth + 16
+                            height: perfText.implicitHeight + 12
+                            color: "#CC2E3440"
+                            radius: 4
+                            Text {
+                                id: perfText
+                                anchors.centerIn: parent
+                                color: "#A3BE8C"
+                                font.family: "monospace"
+                                font.pixelSize: 11
+                                text: uiController.framesPerSecond.toFixed(1) + " fps" + (uiController.tracing ? "  ● REC" : "") +
+                                      "\nparse   " + uiController.parseMs.toFixed(3) + " ms" +
+                                      "\nsample  " + uiController.sampleMs.toFixed(3) + " ms" +
+                                      "\nbox     " + uiController.boxMs.toFixed(3) + " ms" +
+                                      "\nlayout  " + uiController.layoutMs.toFixed(3) + " ms" +
+                                      "\npaint   " + uiController.paintMs.toFixed(3) + " ms" +
+                                      "\nevals   " + uiController.evaluationsPerFrame.toFixed(0) + " /frame" +
+                                      "\nallocs  " + uiController.allocationsPerFrame.toFixed(0) + " /frame" +
+                                      "\ncache   " + (uiController.cacheHitRate * 100).toFixed(0) + "% hits"
                             }
                         }
                     }
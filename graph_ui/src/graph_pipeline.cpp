@@ -0,0 +1,70 @@
+#include "graph_pipeline.hpp"
+#include <utility>
+
+namespace tux_ti83 {
+
+GraphPipeline::GraphPipeline(unsigned threadCount, FrameCallback onFrame)
+    : m_sampler(threadCount), m_onFrame(std::move(onFrame)), m_worker(&GraphPipeline::run, this) {}
+
+GraphPipeline::~GraphPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        m_inFlight.request_stop();
+    }
+    m_wake.notify_one();
+    m_worker.join();
+}
+
+void GraphPipeline::post(GraphRequest request) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inFlight.request_stop();
+        m_inFlight = std::stop_source();
+        m_pending = std::move(request);
+    }
+    m_wake.notify_one();
+}
+
+void GraphPipeline::setThreadCount(unsigned threadCount) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pendingThreads = threadCount;
+}
+
+void GraphPipeline::run() {
+    for (;;) {
+        GraphRequest request;
+        std::stop_token stop;
+        std::optional<unsigned> threads;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_quit || m_pending.has_value(); });
+            if (m_quit) return;
+            request = std::move(*m_pending);
+            m_pending.reset();
+            threads = std::exchange(m_pendingThreads, std::nullopt);
+            stop = m_inFlight.get_token();
+        }
+        if (threads) m_sampler.setThreadCount(*threads);
+
+        std::vector<const CompiledExpression*> functions;
+        std::vector<SampleCache*> caches;
+        for (size_t i = 0; i < request.functions.size(); ++i) {
+            SlotCache& slot = m_caches[request.slots[i]];
+            const uint64_t registryVersion = request.functions[i].bytecode().usesRegistry ? request.registry->version : 0;
+            if (slot.version != request.versions[i] || slot.registryVersion != registryVersion) {
+                slot.cache.clear(); slot.version = request.versions[i]; slot.registryVersion = registryVersion;
+            }
+            functions.push_back(&request.functions[i]);
+            caches.push_back(&slot.cache);
+        }
+
+        auto frame = std::make_shared<GraphFrame>();
+        frame->id = request.id;
+        frame->vp = request.vp;
+        frame->curves = m_sampler.sampleCached(functions, caches, request.vp, request.widthPx, request.heightPx, {}, stop, request.registry.get());
+        if (!stop.stop_requested()) m_onFrame(std::move(frame));
+    }
+}
+
+} // namespace tux_ti83
@@ -0,0 +1,219 @@
+#include "graph_plot_item.hpp"
+#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QSGRenderNode>
+#include <QSGRendererInterface>
+#include <QPainter>
+#include <QLineF>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+
+namespace tux_ti83 {
+
+namespace {
+
+const QRgb kCurveColors[] = {0x88C0D0, 0xBF616A, 0xA3BE8C};
+const QRgb kGridColor = 0x2E3440, kAxisColor = 0xD8DEE9;
+constexpr float kCurveWidth = 2.5f;
+constexpr double kClampPx = 1.0e5; // Keeps asymptotes representable once converted to float
+constexpr int kMaxGridLines = 1000;
+
+// Expands wide segments into quads: most scene-graph APIs only rasterise 1px lines
+void fillGeometryNode(QSGGeometryNode* node, const PlotLayer& layer) {
+    const bool wide = layer.lineWidth > 1.0f;
+    const int count = static_cast<int>(wide ? layer.segments.size() / 2 * 6 : layer.segments.size());
+    QSGGeometry* geometry = node->geometry();
+    geometry->allocate(count);
+    geometry->setDrawingMode(wide ? QSGGeometry::DrawTriangles : QSGGeometry::DrawLines);
+    QSGGeometry::Point2D* v = geometry->vertexDataAsPoint2D();
+    if (!wide) {
+        std::copy(layer.segments.begin(), layer.segments.end(), v);
+    } else {
+        const float hw = layer.lineWidth * 0.5f;
+        for (size_t i = 0; i + 1 < layer.segments.size(); i += 2, v += 6) {
+            const auto& a = layer.segments[i];
+            const auto& b = layer.segments[i + 1];
+            float dx = b.x - a.x, dy = b.y - a.y, len = std::sqrt(dx * dx + dy * dy);
+            float nx = len > 0 ? -dy / len * hw : 0.0f, ny = len > 0 ? dx / len * hw : hw;
+            v[0].set(a.x + nx, a.y + ny); v[1].set(a.x - nx, a.y - ny); v[2].set(b.x + nx, b.y + ny);
+            v[3].set(b.x + nx, b.y + ny); v[4].set(a.x - nx, a.y - ny); v[5].set(b.x - nx, b.y - ny);
+        }
+    }
+    static_cast<QSGFlatColorMaterial*>(node->material())->setColor(layer.color);
+    node->markDirty(QSGNode::DirtyGeometry | QSGNode::DirtyMaterial);
+}
+
+// The software adaptation does not rasterise QSGGeometryNode, so the same buffers are stroked with QPainter
+class PainterPlotNode : public QSGRenderNode {
+public:
+    explicit PainterPlotNode(QQuickWindow* window) : m_window(window) {}
+
+    std::shared_ptr<const std::vector<PlotLayer>> layers; // Shared with the item, never copied
+    QRectF bounds;
+
+    void render(const RenderState* state) override {
+        TUX_PROFILE_STAGE(Paint);
+        auto* p = static_cast<QPainter*>(m_window->rendererInterface()->getResource(m_window, QSGRendererInterface::PainterResource));
+        if (!p || !layers) return;
+        p->save();
+        p->setTransform(matrix()->toTransform());
+        p->setOpacity(inheritedOpacity());
+        const QRegion* clip = state->clipRegion();
+        if (clip && !clip->isEmpty()) p->setClipRegion(*clip, Qt::ReplaceClip);
+        p->setRenderHint(QPainter::Antialiasing);
+        for (const auto& layer : *layers) {
+            m_lines.resize(layer.segments.size() / 2);
+            for (size_t i = 0; i < m_lines.size(); ++i)
+                m_lines[i] = QLineF(layer.segments[2 * i].x, layer.segments[2 * i].y, layer.segments[2 * i + 1].x, layer.segments[2 * i + 1].y);
+            p->setPen(QPen(layer.color, layer.lineWidth));
+            p->drawLines(m_lines.data(), static_cast<int>(m_lines.size()));
+        }
+        p->restore();
+    }
+    StateFlags changedStates() const override { return {}; }
+    RenderingFlags flags() const override { return BoundedRectRendering; }
+    QRectF rect() const override { return bounds; }
+
+private:
+    QQuickWindow* m_window;
+    std::vector<QLineF> m_lines;
+};
+
+} // namespace
+
+GraphPlotItem::GraphPlotItem(QQuickItem* parent) : QQuickItem(parent) {
+    setFlag(ItemHasContents, true);
+}
+
+void GraphPlotItem::setController(UIController* controller) {
+    if (m_controller == controller) return;
+    if (m_controller) disconnect(m_controller, nullptr, this, nullptr);
+    m_controller = controller;
+    if (m_controller) {
+        connect(m_controller, &UIController::viewportChanged, this, &QQuickItem::polish);
+        connect(m_controller, &UIController::graphReady, this, &QQuickItem::polish);
+        m_controller->setPlotSize(width(), height());
+    }
+    emit controllerChanged(); polish();
+}
+
+void GraphPlotItem::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) {
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() == oldGeometry.size()) return;
+    if (m_controller) m_controller->setPlotSize(newGeometry.width(), newGeometry.height());
+    polish();
+}
+
+void GraphPlotItem::updatePolish() {
+    TUX_PROFILE_STAGE(Layout);
+    const float w = static_cast<float>(width()), h = static_cast<float>(height());
+    // Reuse the previous set's buffers when the paint node has let go of it, so steady frames don't allocate
+    std::shared_ptr<std::vector<PlotLayer>> next = m_spare && m_spare.use_count() == 1 ? std::move(m_spare)
+                                                                                      : std::make_shared<std::vector<PlotLayer>>();
+    if (!m_controller || w <= 0 || h <= 0) {
+        next->clear();
+    } else {
+        const Viewport vp = m_controller->viewport();
+        rebuildCurves(*next, vp, w, h);
+        rebuildGrid(*next, vp, w, h);
+    }
+    m_spare = std::move(m_layers);
+    m_layers = std::move(next);
+    m_layersDirty = true;
+    update();
+}
+
+void GraphPlotItem::rebuildGrid(std::vector<PlotLayer>& layers, const Viewport& vp, float w, float h) {
+    const double rangeX = vp.xMax - vp.xMin, rangeY = vp.yMax - vp.yMin;
+    const double step = rangeX > 50 ? 10 : (rangeX < 5 ? 0.5 : 1);
+    PlotLayer& grid = layers[0];
+    PlotLayer& axes = layers[1];
+    grid.color = QColor::fromRgb(kGridColor); axes.color = QColor::fromRgb(kAxisColor);
+    grid.lineWidth = axes.lineWidth = 1.0f;
+    grid.segments.clear(); axes.segments.clear();
+
+    QList<qreal> xTicks, yTicks;
+    int lines = 0;
+    for (double x = std::floor(vp.xMin / step) * step; x <= vp.xMax && lines < kMaxGridLines; x += step, ++lines) {
+        float px = static_cast<float>((x - vp.xMin) * (w / rangeX));
+        auto& layer = std::abs(x) < 0.0001 ? axes : grid;
+        layer.segments.push_back({px, 0.0f}); layer.segments.push_back({px, h});
+        xTicks.append(x);
+    }
+    for (double y = std::floor(vp.yMin / step) * step; y <= vp.yMax && lines < 2 * kMaxGridLines; y += step, ++lines) {
+        float py = static_cast<float>(h - (y - vp.yMin) * (h / rangeY));
+        auto& layer = std::abs(y) < 0.0001 ? axes : grid;
+        layer.segments.push_back({0.0f, py}); layer.segments.push_back({w, py});
+        yTicks.append(y);
+    }
+    if (xTicks != m_xTicks || yTicks != m_yTicks) {
+        m_xTicks = xTicks; m_yTicks = yTicks;
+        emit ticksChanged();
+    }
+}
+
+void GraphPlotItem::rebuildCurves(std::vector<PlotLayer>& layers, const Viewport& vp, float w, float h) {
+    // Latest finished frame, mapped through the current viewport so it tracks pans until the next one lands
+    std::shared_ptr<const GraphFrame> frame = m_controller->latestGraph();
+    static const std::vector<AdaptiveCurve> kNoCurves;
+    const std::vector<AdaptiveCurve>& curves = frame ? frame->curves : kNoCurves;
+    layers.resize(2 + curves.size());
+    const double sx = w / (vp.xMax - vp.xMin), sy = h / (vp.yMax - vp.yMin);
+    auto toPx = [&](double x, double y) {
+        return QSGGeometry::Point2D{static_cast<float>((x - vp.xMin) * sx),
+                                    static_cast<float>(std::clamp(h - (y - vp.yMin) * sy, -kClampPx, h + kClampPx))};
+    };
+    for (size_t f = 0; f < curves.size(); ++f) {
+        PlotLayer& layer = layers[2 + f];
+        layer.color = QColor::fromRgb(kCurveColors[f % std::size(kCurveColors)]);
+        layer.lineWidth = kCurveWidth;
+        layer.segments.clear();
+        if (!curves[f].success) continue;
+        const std::vector<double>& xs = curves[f].xs;
+        const std::vector<double>& ys = curves[f].ys;
+        for (size_t i = 0; i + 1 < ys.size(); ++i) {
+            if (!std::isfinite(ys[i]) || !std::isfinite(ys[i + 1])) continue; // Breaks and gaps
+            layer.segments.push_back(toPx(xs[i], ys[i]));
+            layer.segments.push_back(toPx(xs[i + 1], ys[i + 1]));
+        }
+    }
+}
+
+QSGNode* GraphPlotItem::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData*) {
+    if (oldNode && !m_layersDirty) return oldNode;
+    m_layersDirty = false;
+    TUX_PROFILE_STAGE(Paint);
+    TUX_PROFILE_COUNT(Frames, 1);
+
+    if (window()->rendererInterface()->graphicsApi() == QSGRendererInterface::Software) {
+        auto* node = oldNode ? static_cast<PainterPlotNode*>(oldNode) : new PainterPlotNode(window());
+        node->layers = m_layers; // A reference count, not a copy of every vertex buffer
+        node->bounds = boundingRect();
+        node->markDirty(QSGNode::DirtyMaterial);
+        return node;
+    }
+
+    QSGNode* root = oldNode ? oldNode : new QSGNode;
+    while (root->childCount() > static_cast<int>(m_layers->size())) {
+        QSGNode* last = root->lastChild();
+        root->removeChildNode(last);
+        delete last;
+    }
+    while (root->childCount() < static_cast<int>(m_layers->size())) {
+        auto* node = new QSGGeometryNode;
+        node->setGeometry(new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0));
+        node->setMaterial(new QSGFlatColorMaterial);
+        node->setFlags(QSGNode::OwnsGeometry | QSGNode::OwnsMaterial);
+        root->appendChildNode(node);
+    }
+    QSGNode* child = root->firstChild();
+    for (const auto& layer : *m_layers) {
+        fillGeometryNode(static_cast<QSGGeometryNode*>(child), layer);
+        child = child->nextSibling();
+    }
+    return root;
+}
+
+} // namespace tux_ti83
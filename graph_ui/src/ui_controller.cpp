@@ -1,28 +1,151 @@
 #include "ui_controller.hpp"
+#include "capsules/capsule_interval.hpp"
+#include <QDebug>
 #include <map>
 #include <cmath>
 #include <algorithm>
 
 namespace tux_ti83 {
 
-UIController::UIController(QObject* parent) : QObject(parent), m_activeIdx(0) {
+UIController::UIController(QObject* parent)
+    : QObject(parent), m_activeIdx(0),
+      m_pipeline(0, [this](std::shared_ptr<const GraphFrame> frame) {
+          // Hop back to the GUI thread; dropped automatically if the controller is gone
+          QMetaObject::invokeMethod(this, [this, frame]() { publishGraph(frame); }, Qt::QueuedConnection);
+      }) {
     m_functionBuffers.resize(3);
+    m_compiledFunctions.resize(3);
+    m_functionVersions.resize(3, 1);
     m_displayStrings.resize(3, "");
+    connect(this, &UIController::viewportChanged, this, &UIController::requestGraph);
+    connect(this, &UIController::functionsChanged, this, &UIController::requestGraph);
+    m_perfTimer.setInterval(500);
+    connect(&m_perfTimer, &QTimer::timeout, this, &UIController::refreshPerf);
+}
+
+const CompiledExpression& UIController::compiledFunction(size_t index) {
+    auto& compiled = m_compiledFunctions[index];
+    if (!compiled) compiled.emplace(m_functionBuffers[index]);
+    return *compiled;
+}
+
+void UIController::invalidateFunction(size_t index) {
+    m_compiledFunctions[index].reset();
+    ++m_functionVersions[index];
+    emit functionsChanged();
+}
+
+std::vector<const CompiledExpression*> UIController::activeFunctions() {
+    std::vector<const CompiledExpression*> functions;
+    for (size_t f = 0; f < m_functionBuffers.size(); ++f)
+        if (!m_functionBuffers[f].empty()) functions.push_back(&compiledFunction(f));
+    return functions;
+}
+
+void UIController::setPlotSize(double widthPx, double heightPx) {
+    if (widthPx == m_plotWidth && heightPx == m_plotHeight) return;
+    m_plotWidth = widthPx; m_plotHeight = heightPx;
+    requestGraph();
+}
+
+void UIController::requestGraph() {
+    if (m_plotWidth <= 0 || m_plotHeight <= 0) return;
+    GraphRequest request;
+    request.id = m_nextGraphId++;
+    request.vp = viewport();
+    request.widthPx = m_plotWidth; request.heightPx = m_plotHeight;
+    request.registry = MathStateMachine::registry();
+    for (size_t f = 0; f < m_functionBuffers.size(); ++f) {
+        if (m_functionBuffers[f].empty()) continue;
+        request.functions.push_back(compiledFunction(f));
+        request.slots.push_back(f);
+        request.versions.push_back(m_functionVersions[f]);
+    }
+    m_pipeline.post(std::move(request));
+}
+
+void UIController::publishGraph(std::shared_ptr<const GraphFrame> frame) {
+    if (m_graph && frame->id <= m_graph->id) return;
+    m_graph = std::move(frame);
+    emit graphReady();
+}
+
+void UIController::setSamplerThreads(int threads) {
+    if (threads < 0 || threads == samplerThreads()) return;
+    m_sampler.setThreadCount(static_cast<unsigned>(threads));
+    m_pipeline.setThreadCount(static_cast<unsigned>(threads));
+    emit samplerThreadsChanged();
+    requestGraph(); // Redraws with the new pool
+}
+
+void UIController::setPerfOverlay(bool on) {
+    if (on == perfOverlay() || (on && !profile::kEnabled)) return;
+    if (on) { m_perfLast = profile::snapshot(); m_perfTimer.start(); }
+    else m_perfTimer.stop();
+    emit perfOverlayChanged();
+}
+
+void UIController::setTracing(bool on) {
+    if (on == tracing()) return;
+    if (on ? profile::startTrace() : profile::stopTrace()) emit tracingChanged();
+}
+
+bool UIController::writeTrace(const QString& path) { return profile::writeTrace(path.toStdString()); }
+
+void UIController::refreshPerf() {
+    using profile::Counter;
+    const profile::Snapshot now = profile::snapshot();
+    auto delta = [&](Counter c) { return double(now.counters[size_t(c)] - m_perfLast.counters[size_t(c)]); };
+    const double seconds = double(now.timeNs - m_perfLast.timeNs) / 1e9;
+    const double frames = delta(Counter::Frames), perFrame = 1.0 / std::max(1.0, frames);
+    const double hits = delta(Counter::CacheHits), lookups = hits + delta(Counter::CacheMisses);
+    m_perf.framesPerSecond = seconds > 0 ? frames / seconds : 0.0;
+    m_perf.evaluationsPerFrame = delta(Counter::Evaluations) * perFrame;
+    m_perf.allocationsPerFrame = delta(Counter::Allocations) * perFrame;
+    m_perf.cacheHitRate = lookups > 0 ? hits / lookups : 0.0;
+    for (size_t i = 0; i < profile::kStageCount; ++i) m_perf.stageMs[i] = double(now.stageNs[i] - m_perfLast.stageNs[i]) / 1e6 * perFrame;
+    m_perfLast = now;
+    emit perfChanged();
 }
 
 QString UIController::currentDisplay() const { return m_displayStrings[m_activeIdx]; }
 
+QStringList UIController::history() const {
+    const HistoryRing& ring = m_session.state().history;
+    QStringList entries;
+    entries.reserve(static_cast<qsizetype>(ring.size()));
+    for (size_t i = 0; i < ring.size(); ++i) entries.append(QString::fromUtf8(ring[i].data(), static_cast<qsizetype>(ring[i].size())));
+    return entries;
+}
+
+bool UIController::openSession(const QString& path) {
+    std::string error;
+    if (!m_session.open(path.toStdString(), error)) { qDebug() << "Session:" << QString::fromStdString(error); return false; }
+    const SessionState& state = m_session.state();
+    for (size_t f = 0; f < std::min(state.functions.size(), m_functionBuffers.size()); ++f) {
+        m_functionBuffers[f] = state.functions[f];
+        m_displayStrings[f] = QString::fromStdString(state.displays[f]);
+        invalidateFunction(f);
+    }
+    for (const auto& [name, matrix] : state.matrices) MathStateMachine::setMatrix(name, matrix);
+    for (const auto& [name, list] : state.lists) MathStateMachine::setList(name, list);
+    emit functionsChanged(); emit displayChanged(); emit historyChanged();
+    return true;
+}
+
 void UIController::processInput(const QString& input) {
     auto& currentBuf = m_functionBuffers[m_activeIdx];
     auto& currentStr = m_displayStrings[m_activeIdx];
 
     if (input == "C") { 
-        currentStr = ""; currentBuf.clear(); emit displayChanged(); return; 
+        currentStr = ""; currentBuf.clear(); invalidateFunction(m_activeIdx); saveFunction(m_activeIdx);
+        emit displayChanged(); return; 
     }
 
     if (input == "DEL") {
         if (!currentBuf.empty()) {
             currentBuf.pop_back();
+            invalidateFunction(m_activeIdx);
             currentStr = "";
             static std::map<Token, QString> revMap = {
                 {Token::Add, "+"}, {Token::Sub, "−"}, {Token::Mul, "×"}, {Token::Div, "÷"},
@@ -31,21 +154,26 @@ void UIController::processInput(const QString& input) {
                 {Token::Log, "log("}, {Token::Ln, "ln("}, {Token::Sqrt, "√("},
                 {Token::Pow, "^"}, {Token::Pi, "π"}, {Token::VarX, "X"},
                 {Token::LeftParen, "("}, {Token::RightParen, ")"}, {Token::Decimal, "."},
-                {Token::MatA, "[A]"}, {Token::MatB, "[B]"}, {Token::MatC, "[C]"}
+                {Token::MatA, "[A]"}, {Token::MatB, "[B]"}, {Token::MatC, "[C]"},
+                {Token::Det, "det("}, {Token::Transpose, "ᵀ"}, {Token::Inverse, "⁻¹"},
+                {Token::List1, "L1"}, {Token::List2, "L2"}, {Token::List3, "L3"},
+                {Token::List4, "L4"}, {Token::List5, "L5"}, {Token::List6, "L6"},
+                {Token::Sum, "sum("}, {Token::Mean, "mean("}, {Token::StdDev, "stdDev("},
+                {Token::SortA, "SortA("}, {Token::CumSum, "cumSum("}, {Token::LinReg, "LinReg("}, {Token::Comma, ","}
             };
             for (auto t : currentBuf) {
                 int val = static_cast<int>(t);
                 if (val >= 0 && val <= 9) currentStr += QString::number(val);
                 else if (revMap.count(t)) currentStr += revMap[t];
             }
+            saveFunction(m_activeIdx);
         }
         emit displayChanged();
         return;
     }
     
     if (input == "ENTER" || input == "▶Frac") {
-        MathStateMachine msm;
-        CalculationResult result = msm.evaluate(currentBuf);
+        CalculationResult result = compiledFunction(m_activeIdx).evaluate();
         QString entry = "Y" + QString::number(m_activeIdx + 1) + ": " + currentStr + " = ";
         if (result.success) {
             if (result.isMatrix) {
@@ -58,6 +186,13 @@ void UIController::processInput(const QString& input) {
                     if (i < result.matrixValue.rows - 1) matStr += "][";
                 }
                 currentStr = matStr + "]]";
+            } else if (result.isList) {
+                QString listStr = "{";
+                for (size_t i = 0; i < result.listValue.size(); ++i) {
+                    if (i) listStr += " ";
+                    listStr += QString::number(result.listValue.data()[i]);
+                }
+                currentStr = listStr + "}";
             } else {
                 std::string fracStr = MathStateMachine::toFraction(result.value);
                 currentStr = (fracStr.empty()) ? QString::number(result.value) : QString::fromStdString(fracStr);
@@ -65,7 +200,8 @@ void UIController::processInput(const QString& input) {
         } else {
             currentStr = "ERR";
         }
-        entry += currentStr; m_history.prepend(entry);
+        entry += currentStr;
+        m_session.saveHistory(entry.toStdString()); saveFunction(m_activeIdx);
         emit historyChanged(); emit displayChanged();
         return;
     }
@@ -80,36 +216,72 @@ void UIController::processInput(const QString& input) {
         {"log", Token::Log}, {"ln", Token::Ln}, {"asin", Token::ASin}, {"acos", Token::ACos}, 
         {"atan", Token::ATan}, {"=", Token::Equal}, {"≠", Token::NotEqual}, {"<", Token::Less}, 
         {">", Token::Greater}, {"and", Token::And}, {"or", Token::Or}, {"not", Token::Not},
-        {"[A]", Token::MatA}, {"[B]", Token::MatB}, {"[C]", Token::MatC}
+        {"[A]", Token::MatA}, {"[B]", Token::MatB}, {"[C]", Token::MatC},
+        {"det", Token::Det}, {"ᵀ", Token::Transpose}, {"⁻¹", Token::Inverse},
+        {"L1", Token::List1}, {"L2", Token::List2}, {"L3", Token::List3},
+        {"L4", Token::List4}, {"L5", Token::List5}, {"L6", Token::List6}, {",", Token::Comma},
+        {"sum", Token::Sum}, {"mean", Token::Mean}, {"stdDev", Token::StdDev},
+        {"SortA", Token::SortA}, {"cumSum", Token::CumSum}, {"LinReg", Token::LinReg}
     };
 
     if (tokenMap.count(input)) {
         currentBuf.push_back(tokenMap.at(input));
-        if (input.length() > 1 && input != "[A]" && input != "[B]" && input != "[C]") currentStr += input + "(";
+        invalidateFunction(m_activeIdx);
+        const bool operand = input == "[A]" || input == "[B]" || input == "[C]" || input == "⁻¹" || (input.startsWith('L') && input.length() == 2);
+        if (input.length() > 1 && !operand) currentStr += input + "(";
         else currentStr += input;
+        saveFunction(m_activeIdx);
         emit displayChanged();
     }
 }
 
 void UIController::updateMatrix(const QString& name, int rows, int cols, const QVariantList& values) {
-    Matrix mat; mat.rows = rows; mat.cols = cols;
-    for (const auto& v : values) mat.data.push_back(v.toDouble());
-    if (name == "[A]") MathStateMachine::matrixRegistry[Token::MatA] = mat;
-    else if (name == "[B]") MathStateMachine::matrixRegistry[Token::MatB] = mat;
-    else if (name == "[C]") MathStateMachine::matrixRegistry[Token::MatC] = mat;
+    std::vector<double> elements;
+    for (const auto& v : values) elements.push_back(v.toDouble());
+    Matrix mat(rows, cols, std::move(elements));
+    Token token;
+    if (name == "[A]") token = Token::MatA;
+    else if (name == "[B]") token = Token::MatB;
+    else if (name == "[C]") token = Token::MatC;
+    else return;
+    m_session.saveMatrix(token, mat);
+    MathStateMachine::setMatrix(token, std::move(mat)); // Samplers still pinning the old snapshot keep its storage alive
+    emit functionsChanged();
+}
+
+void UIController::updateList(const QString& name, const QVariantList& values) {
+    static const QStringList names = {"L1", "L2", "L3", "L4", "L5", "L6"};
+    const int index = names.indexOf(name);
+    if (index < 0) return;
+    const Token token = static_cast<Token>(static_cast<int>(Token::List1) + index);
+    std::vector<double> elements;
+    elements.reserve(values.size());
+    for (const auto& v : values) elements.push_back(v.toDouble());
+    List list(std::move(elements));
+    m_session.saveList(token, list);
+    MathStateMachine::setList(token, std::move(list));
+    emit functionsChanged();
 }
 
 void UIController::zoomFit() {
     double minVal = 1e308, maxVal = -1e308; bool found = false;
-    MathStateMachine msm;
-    for (const auto& buffer : m_functionBuffers) {
-        if (buffer.empty()) continue;
-        for (int i = 0; i <= 100; ++i) {
-            double x = m_xMin + (i * (m_xMax - m_xMin) / 100.0);
-            CalculationResult res = msm.evaluate(buffer, x);
-            if (res.success && std::isfinite(res.value)) {
-                minVal = std::min(minVal, res.value); maxVal = std::max(maxVal, res.value); found = true;
-            }
+    auto include = [&](double lo, double hi) { minVal = std::min(minVal, lo); maxVal = std::max(maxVal, hi); found = true; };
+    // Interval bounds catch spikes between sample points and need no sampling for most curves; functions they
+    // cannot bound (poles, registry reads) fall back to 101 samples across the view
+    const std::vector<const CompiledExpression*> functions = activeFunctions();
+    std::vector<RangeBound> bounds(functions.size());
+    m_sampler.parallelFor(functions.size(), [&](size_t f) { bounds[f] = boundRange(*functions[f], m_xMin, m_xMax); });
+    std::vector<const CompiledExpression*> unbounded;
+    for (size_t f = 0; f < functions.size(); ++f) {
+        if (bounds[f].bounded) include(bounds[f].lo, bounds[f].hi);
+        else unbounded.push_back(functions[f]);
+    }
+    std::vector<double> xs(101);
+    for (int i = 0; i <= 100; ++i) xs[i] = m_xMin + (i * (m_xMax - m_xMin) / 100.0);
+    for (const auto& series : unbounded.empty() ? std::vector<SampleSeries>{} : m_sampler.sample(unbounded, xs)) {
+        if (!series.success) continue;
+        for (double y : series.ys) {
+            if (std::isfinite(y)) include(y, y);
         }
     }
     if (found) {
@@ -121,15 +293,16 @@ void UIController::zoomFit() {
 
 QVariantList UIController::getMultiGraphPoints(int resolution) {
     QVariantList allFunctions; double step = (m_xMax - m_xMin) / resolution;
-    MathStateMachine msm;
-    for (size_t f = 0; f < m_functionBuffers.size(); ++f) {
-        if (m_functionBuffers[f].empty()) continue;
+    if (resolution < 1) return allFunctions;
+    std::vector<double> xs(resolution + 1);
+    for (int i = 0; i <= resolution; ++i) xs[i] = m_xMin + (i * step);
+    const std::vector<SampleSeries> sampled = m_sampler.sample(activeFunctions(), xs);
+    TUX_PROFILE_STAGE(Box);
+    for (const auto& series : sampled) {
         QVariantList points;
-        for (int i = 0; i <= resolution; ++i) {
-            double x = m_xMin + (i * step);
-            CalculationResult res = msm.evaluate(m_functionBuffers[f], x);
-            if (res.success && !res.isMatrix) {
-                QVariantMap pt; pt["x"] = x; pt["y"] = res.value; points.append(pt);
+        if (series.success) {
+            for (int i = 0; i <= resolution; ++i) {
+                QVariantMap pt; pt["x"] = xs[i]; pt["y"] = series.ys[i]; points.append(pt);
             }
         }
         allFunctions.append(QVariant::fromValue(points));
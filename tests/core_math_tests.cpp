@@ -0,0 +1,606 @@
+// Unit tests for core_math: `ctest --test-dir build` (or run core_math_tests directly)
+#include "capsules/capsule_interval.hpp"
+#include "capsules/capsule_list.hpp"
+#include "capsules/capsule_math.hpp"
+#include "capsules/capsule_optimizer.hpp"
+#include "capsules/capsule_sampler.hpp"
+#include "capsules/capsule_session.hpp"
+#include "capsules/capsule_tokenizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace tux_ti83;
+using T = Token;
+
+int g_failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++g_failures; } } while (0)
+
+// Bitwise equality that also treats two NaNs as equal
+bool same(double a, double b) { return (std::isnan(a) && std::isnan(b)) || a == b; }
+
+void inverseTrigMatchesLibm() {
+    const struct { Token t; double (*f)(double); } cases[] = {{T::ASin, std::asin}, {T::ACos, std::acos}, {T::ATan, std::atan}};
+    const std::vector<double> xs = {-3.0, -1.0, -0.75, -0.5, 0.0, 0.25, 0.5, 0.999, 1.0, 2.0, 40.0};
+    for (const auto& c : cases) {
+        const CompiledExpression expr({c.t, T::LeftParen, T::VarX, T::RightParen});
+        std::vector<double> ys(xs.size());
+        CHECK(expr.evaluateBatch(xs, ys));
+        for (size_t i = 0; i < xs.size(); ++i) {
+            const CalculationResult r = expr.evaluate(xs[i]);
+            CHECK(r.success);
+            CHECK(same(r.value, c.f(xs[i])));
+            CHECK(same(ys[i], c.f(xs[i])));
+        }
+        // Constant arguments are folded by the optimizer through the same kernels
+        const CompiledExpression folded({c.t, T::LeftParen, T::Num0, T::Decimal, T::Num5, T::RightParen});
+        CHECK(same(folded.evaluate().value, c.f(0.5)));
+    }
+}
+
+// Zoom Fit must bound the inverse trig functions by their true ranges, not give up on them
+void inverseTrigIntervals() {
+    const CompiledExpression asinX({T::ASin, T::LeftParen, T::VarX, T::RightParen});
+    const RangeBound a = boundRange(asinX, -10, 10);
+    CHECK(a.bounded && a.lo >= -M_PI_2 - 1e-3 && a.lo <= -M_PI_2 && a.hi >= M_PI_2 && a.hi <= M_PI_2 + 1e-3);
+
+    const CompiledExpression acosX({T::ACos, T::LeftParen, T::VarX, T::RightParen});
+    const Interval c = evaluateInterval(acosX, {0.0, 0.5, false});
+    CHECK(!c.nan && c.lo <= std::acos(0.5) && c.hi >= M_PI_2 && c.hi - c.lo < 0.53);
+    CHECK(evaluateInterval(acosX, {0.5, 2.0, false}).nan);
+
+    const CompiledExpression atanX({T::ATan, T::LeftParen, T::VarX, T::RightParen});
+    const Interval t = evaluateInterval(atanX, {-HUGE_VAL, HUGE_VAL, false});
+    CHECK(t.isBounded() && t.lo <= -M_PI_2 && t.hi >= M_PI_2);
+}
+
+// The spike guard still finds a needle between coarse samples, within its interval evaluation budget
+void adaptiveGuardBudget() {
+    const size_t coarse = 100; // 800 px at the default 8 px spacing
+    const CompiledExpression needle({T::Num1, T::Div, T::LeftParen, T::Num1, T::Add, T::Num1, T::Num0, T::Num0, T::Num0, T::Num0, T::Num0,
+                                     T::Num0, T::Num0, T::Mul, T::LeftParen, T::VarX, T::Sub, T::Decimal, T::Num3, T::Num1, T::RightParen,
+                                     T::Pow, T::Num2, T::RightParen}); // 1/(1+10⁷(X-.31)²)
+    const AdaptiveCurve found = sampleAdaptive(needle, {-10, 10, -10, 10}, 800, 600);
+    double peak = 0;
+    for (double y : found.ys) if (std::isfinite(y)) peak = std::max(peak, y);
+    CHECK(found.success && peak > 0.1);
+    CHECK(found.intervalEvaluations <= 3 * coarse);
+
+    // A smooth curve is cleared by its coarse enclosures and never checked again however finely it is refined
+    const CompiledExpression trig({T::Sin, T::LeftParen, T::VarX, T::RightParen, T::Mul, T::Cos, T::LeftParen, T::VarX, T::RightParen});
+    const AdaptiveCurve smooth = sampleAdaptive(trig, {-10, 10, -10, 10}, 800, 600);
+    CHECK(smooth.success && smooth.intervalEvaluations < 2 * coarse);
+
+    // sin²+cos² keeps overshooting its flat samples, so it is the case the budget exists for
+    const CompiledExpression one({T::Sin, T::LeftParen, T::VarX, T::RightParen, T::Pow, T::Num2, T::Add,
+                                  T::Cos, T::LeftParen, T::VarX, T::RightParen, T::Pow, T::Num2});
+    CHECK(sampleAdaptive(one, {-10, 10, -10, 10}, 800, 600).intervalEvaluations <= 3 * coarse);
+}
+
+// A pinned snapshot is what batches and sampling read, whatever has been published since
+void pinnedRegistrySampling() {
+    MathStateMachine::setList(T::List1, List({1.0, 2.0}));
+    const std::shared_ptr<const RegistrySnapshot> pinned = MathStateMachine::registry();
+    MathStateMachine::setList(T::List1, List({10.0, 20.0}));
+
+    const CompiledExpression expr({T::Sum, T::LeftParen, T::List1, T::RightParen, T::Add, T::VarX});
+    const std::vector<double> xs = {0.0, 1.0, 2.5};
+    std::vector<double> ys(xs.size());
+    CHECK(expr.evaluateBatch(xs, ys, *pinned));
+    for (size_t i = 0; i < xs.size(); ++i) CHECK(ys[i] == 3.0 + xs[i]);
+    CHECK(expr.evaluateBatch(xs, ys));
+    for (size_t i = 0; i < xs.size(); ++i) CHECK(ys[i] == 30.0 + xs[i]);
+
+    const AdaptiveCurve old = sampleAdaptive(expr, {-10, 10, -50, 50}, 800, 600, {}, {}, pinned.get());
+    CHECK(old.success && !old.xs.empty());
+    for (size_t i = 0; i < old.xs.size(); ++i) CHECK(std::isnan(old.ys[i]) || old.ys[i] == 3.0 + old.xs[i]);
+
+    ParallelSampler sampler(1);
+    const std::vector<SampleSeries> series = sampler.sample({&expr}, xs, pinned.get());
+    CHECK(series.size() == 1 && series[0].success && series[0].ys[2] == 5.5);
+}
+
+// Tokens are saved by stable id and the file carries its format version; optimizer-only tokens never get in
+void sessionRoundTrip() {
+    const std::string path = "core_math_tests_session.tux";
+    std::remove(path.c_str());
+    const std::vector<Token> fn = {T::ASin, T::LeftParen, T::VarX, T::RightParen, T::Add, T::List2};
+    std::string error;
+    {
+        SessionLog log;
+        CHECK(log.open(path, error));
+        CHECK(log.saveFunction(0, fn, "asin(X)+L2"));
+        CHECK(log.saveMatrix(T::MatC, Matrix(1, 2, {1.5, -2.0})));
+        CHECK(log.saveList(T::List6, List({3.0, 4.0})));
+        CHECK(!log.saveFunction(1, {T::VarX, T::Recip}, "bad"));
+        CHECK(!log.saveFunction(1, {T::Store, T::Load, T::NotCompare}, "bad"));
+        CHECK(!log.saveList(T::Sum, List({1.0})));
+        CHECK(log.state().functions.size() == 1);
+    }
+    {
+        SessionLog log;
+        CHECK(log.open(path, error));
+        const SessionState& state = log.state();
+        CHECK(state.functions.size() == 1 && state.functions[0] == fn && state.displays[0] == "asin(X)+L2");
+        CHECK(state.matrices.size() == 1 && state.matrices.count(T::MatC) && state.matrices.at(T::MatC).at(0, 1) == -2.0);
+        CHECK(state.lists.size() == 1 && state.lists.count(T::List6) && state.lists.at(T::List6).size() == 2);
+    }
+    {
+        // A log of the first format (raw enum ordinals) is refused and left as it was
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << "TUXSESS1";
+        SessionLog log;
+        CHECK(!log.open(path, error) && error.find("version") != std::string::npos);
+        std::ifstream in(path, std::ios::binary);
+        CHECK(std::string(std::istreambuf_iterator<char>(in), {}) == "TUXSESS1");
+    }
+    std::remove(path.c_str());
+}
+
+// ÷c becomes ×(1/c) only when 1/c is exact, so the optimized program rounds like the literal division
+void divisionByConstantIsExact() {
+    const CompiledExpression byFour({T::VarX, T::Div, T::Num4});
+    const CompiledExpression byTen({T::VarX, T::Div, T::Num1, T::Num0});
+    CHECK(disassemble(byFour.program()) == "x 0.25 mul");
+    CHECK(disassemble(byTen.program()) == "x 10 div");
+    std::vector<double> xs;
+    for (int i = 1; i <= 1000; ++i) xs.push_back(i * 0.1 + 1.0 / i);
+    std::vector<double> four(xs.size()), ten(xs.size());
+    CHECK(byFour.evaluateBatch(xs, four) && byTen.evaluateBatch(xs, ten));
+    for (size_t i = 0; i < xs.size(); ++i) {
+        CHECK(four[i] == xs[i] / 4);
+        CHECK(ten[i] == xs[i] / 10);
+        CHECK(byTen.evaluate(xs[i]).value == xs[i] / 10);
+    }
+}
+
+std::string optimized(const std::vector<Token>& graph) { return disassemble(CompiledExpression(graph).program()); }
+
+// Golden output of each optimizer pass, so a change in what it emits is a visible test change
+void optimizerGoldenPrograms() {
+    // Every X-free subtree folds to one constant, whatever operators it uses
+    CHECK(optimized({T::VarX, T::Add, T::Num2, T::Mul, T::Num3, T::Sub, T::Sin, T::LeftParen, T::Num0, T::RightParen}) == "x 6 add");
+    // A repeated subexpression is computed and stored once, then loaded
+    CHECK(optimized({T::Sin, T::LeftParen, T::VarX, T::RightParen, T::Add, T::Sin, T::LeftParen, T::VarX, T::RightParen}) ==
+          "x sin store0 load0 add");
+    CHECK(optimized({T::LeftParen, T::VarX, T::Add, T::Num1, T::RightParen, T::Mul, T::LeftParen, T::Num1, T::Add, T::VarX, T::RightParen}) ==
+          "x 1 add store0 load0 mul");
+    // X^e for each exponent with a rewrite; -1 and -2 are written 0-1 and 0-2 and folded first
+    const struct { std::vector<Token> exponent; const char* program; } powers[] = {
+        {{T::Num0}, "1"},
+        {{T::Num1}, "x"},
+        {{T::Num2}, "x x mul"},
+        {{T::Num3}, "x x x mul mul"},
+        {{T::Num4}, "x x mul store0 load0 mul"},
+        {{T::LeftParen, T::Num0, T::Sub, T::Num1, T::RightParen}, "x recip"},
+        {{T::LeftParen, T::Num0, T::Sub, T::Num2, T::RightParen}, "x x mul recip"},
+        {{T::Num5}, "x 5 pow"},
+    };
+    for (const auto& p : powers) {
+        std::vector<Token> graph = {T::VarX, T::Pow};
+        graph.insert(graph.end(), p.exponent.begin(), p.exponent.end());
+        CHECK(optimized(graph) == p.program);
+    }
+    // not over a comparison is one NotCompare, and two nots cancel back to the comparison
+    CHECK(optimized({T::Not, T::LeftParen, T::VarX, T::Less, T::Num2, T::RightParen}) == "x 2 not-lt");
+    CHECK(optimized({T::Not, T::LeftParen, T::Not, T::LeftParen, T::VarX, T::Less, T::Num2, T::RightParen, T::RightParen}) == "x 2 lt");
+    // Matrices are read at evaluation time and never folded
+    CHECK(optimized({T::Det, T::LeftParen, T::MatA, T::RightParen, T::Add, T::Num1, T::Add, T::Num1}) == "[A] det 1 add 1 add");
+}
+
+// Distance in representable doubles between two finite values of the same sign
+int64_t ulpDistance(double a, double b) {
+    int64_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(ia));
+    std::memcpy(&ib, &b, sizeof(ib));
+    return ia > ib ? ia - ib : ib - ia;
+}
+
+// The optimized program agrees with the unoptimized one over an X sweep. Pow rewrites are allowed a few ULPs: X^3
+// and X^4 round after each multiply, X^-2 after the multiply and the reciprocal, and libm's pow is itself not
+// correctly rounded, so even X^-1 as one exact reciprocal can sit an ULP away. X^2 is one multiply like pow.
+// Everything else, including domain errors and ÷0, must match bit for bit
+void optimizerPreservesResults() {
+    const struct { std::vector<Token> graph; int64_t ulps; } cases[] = {
+        {{T::VarX, T::Add, T::Num2, T::Mul, T::Num3, T::Sub, T::Sin, T::LeftParen, T::Num0, T::RightParen}, 0},
+        {{T::Sin, T::LeftParen, T::VarX, T::RightParen, T::Add, T::Sin, T::LeftParen, T::VarX, T::RightParen}, 0},
+        {{T::VarX, T::Pow, T::Num0}, 0},
+        {{T::VarX, T::Pow, T::Num1}, 0},
+        {{T::VarX, T::Pow, T::Num2}, 0},
+        {{T::VarX, T::Pow, T::Num3}, 2},
+        {{T::VarX, T::Pow, T::Num4}, 3},
+        {{T::VarX, T::Pow, T::LeftParen, T::Num0, T::Sub, T::Num1, T::RightParen}, 1},
+        {{T::VarX, T::Pow, T::LeftParen, T::Num0, T::Sub, T::Num2, T::RightParen}, 2},
+        {{T::Not, T::LeftParen, T::VarX, T::GreaterEq, T::Num1, T::RightParen}, 0},
+        {{T::Sqrt, T::LeftParen, T::VarX, T::RightParen, T::Div, T::LeftParen, T::VarX, T::Sub, T::VarX, T::RightParen}, 0},
+        {{T::Ln, T::LeftParen, T::VarX, T::RightParen, T::Mul, T::Ln, T::LeftParen, T::VarX, T::RightParen}, 0},
+        {{T::VarX, T::Div, T::Num8, T::And, T::Not, T::LeftParen, T::VarX, T::Equal, T::Num0, T::RightParen}, 0},
+    };
+    std::vector<double> xs;
+    for (int i = -600; i <= 600; ++i) xs.push_back(i / 37.0);
+    xs.insert(xs.end(), {0.0, -0.0, 1e-300, -1e300, 1e200});
+    for (const auto& c : cases) {
+        const CompiledExpression fast(c.graph), plain(c.graph, false);
+        std::vector<double> a(xs.size()), b(xs.size());
+        CHECK(fast.evaluateBatch(xs, a) && plain.evaluateBatch(xs, b));
+        for (size_t i = 0; i < xs.size(); ++i) {
+            CHECK(same(a[i], fast.evaluate(xs[i]).value));
+            const bool close = same(a[i], b[i]) || (std::isfinite(a[i]) && std::isfinite(b[i]) && ulpDistance(a[i], b[i]) <= c.ulps);
+            if (!close) std::fprintf(stderr, "  %s at x=%.17g: %.17g vs %.17g\n", optimized(c.graph).c_str(), xs[i], a[i], b[i]);
+            CHECK(close);
+        }
+    }
+}
+
+// Singularity is judged relative to each row and column, so a badly scaled matrix still inverts
+void luScaledAndSingular() {
+    const Matrix scaled(2, 2, {1e-20, 0.0, 0.0, 1e20});
+    CHECK(std::abs(matrixDeterminant(scaled) - 1.0) < 1e-15);
+    Matrix inv;
+    CHECK(matrixInverse(scaled, inv));
+    CHECK(inv.at(0, 0) == 1e20 && inv.at(1, 1) == 1e-20 && inv.at(0, 1) == 0.0 && inv.at(1, 0) == 0.0);
+
+    // Columns of very different size: det is 1e-20, not zero
+    const Matrix columns(2, 2, {1e-20, 1.0, 1e-20, 2.0});
+    CHECK(std::abs(matrixDeterminant(columns) / 1e-20 - 1.0) < 1e-12);
+    CHECK(matrixInverse(columns, inv) && std::abs(inv.at(0, 0) / 2e20 - 1.0) < 1e-12);
+
+    // Exactly and numerically singular matrices are both refused
+    const Matrix exact(2, 2, {1.0, 2.0, 2.0, 4.0});
+    const Matrix rounded(3, 3, {1, 2, 3, 4, 5, 6, 7, 8, 9});
+    const Matrix zeroRow(2, 2, {1.0, 2.0, 0.0, 0.0});
+    for (const Matrix* m : {&exact, &rounded, &zeroRow}) {
+        CHECK(matrixDeterminant(*m) == 0.0);
+        CHECK(!matrixInverse(*m, inv));
+    }
+    MathStateMachine::setMatrix(T::MatA, rounded);
+    const CalculationResult singular = CompiledExpression({T::MatA, T::Inverse}).evaluate();
+    CHECK(!singular.success && singular.error_message == "Singular Matrix");
+}
+
+// Rectangular, square and shared transposes all give the same elements; shared storage is left alone
+void transposeShapes() {
+    for (const auto [r, c] : {std::pair{1, 5}, {5, 1}, {2, 3}, {3, 2}, {7, 13}, {40, 33}, {33, 33}, {70, 70}}) {
+        std::vector<double> values(static_cast<size_t>(r) * c);
+        for (size_t i = 0; i < values.size(); ++i) values[i] = static_cast<double>(i);
+        const Matrix original(r, c, values);
+        Matrix own(r, c, values), shared = original;
+        matrixTranspose(own);
+        matrixTranspose(shared);
+        CHECK(own.rows == c && own.cols == r && shared.rows == c && shared.cols == r);
+        bool ok = true;
+        for (int i = 0; i < r; ++i)
+            for (int j = 0; j < c; ++j) ok = ok && own.at(j, i) == original.at(i, j) && shared.at(j, i) == original.at(i, j);
+        CHECK(ok);
+        CHECK(original.rows == r && original.at(r - 1, c - 1) == values.back() && (r == 1 || original.at(1, 0) == c));
+    }
+}
+
+// The rules of the original Operand-stack interpreter, restated: x÷0 is 0, √ of a negative is 0, log and ln of a
+// non-positive are -∞, = and ≠ compare within 1e-9, and logic treats |v| > 1e-9 as true
+double interpreterReference(Token t, double a, double b) {
+    auto truth = [](double v) { return std::abs(v) > 1e-9; };
+    switch (t) {
+        case T::Sin: return std::sin(a);
+        case T::Cos: return std::cos(a);
+        case T::Tan: return std::tan(a);
+        case T::Sqrt: return a >= 0 ? std::sqrt(a) : 0.0;
+        case T::Log: return a > 0 ? std::log10(a) : -HUGE_VAL;
+        case T::Ln: return a > 0 ? std::log(a) : -HUGE_VAL;
+        case T::Not: return truth(a) ? 0.0 : 1.0;
+        case T::Add: return a + b;
+        case T::Sub: return a - b;
+        case T::Mul: return a * b;
+        case T::Div: return b == 0 ? 0.0 : a / b;
+        case T::Pow: return std::pow(a, b);
+        case T::Equal: return std::abs(a - b) < 1e-9 ? 1.0 : 0.0;
+        case T::NotEqual: return std::abs(a - b) > 1e-9 ? 1.0 : 0.0;
+        case T::Less: return a < b ? 1.0 : 0.0;
+        case T::LessEq: return a <= b ? 1.0 : 0.0;
+        case T::Greater: return a > b ? 1.0 : 0.0;
+        case T::GreaterEq: return a >= b ? 1.0 : 0.0;
+        case T::And: return truth(a) && truth(b) ? 1.0 : 0.0;
+        case T::Or: return truth(a) || truth(b) ? 1.0 : 0.0;
+        case T::Xor: return truth(a) != truth(b) ? 1.0 : 0.0;
+        default: return std::nan("");
+    }
+}
+
+// The register VM and the column kernels both agree with the interpreter on every scalar operator, over an X sweep
+// that hits zero divisors, domain edges and exact comparison ties; with and without the optimizer
+void vmMatchesInterpreter() {
+    std::vector<double> xs;
+    for (int i = -300; i <= 300; ++i) xs.push_back(i / 40.0);
+    xs.insert(xs.end(), {1e-10, -1e-10, 2.0 + 1e-12, 1e300, -1e300});
+    const Token unary[] = {T::Sin, T::Cos, T::Tan, T::Sqrt, T::Log, T::Ln, T::Not};
+    const Token binary[] = {T::Add, T::Sub, T::Mul, T::Div, T::Pow, T::Equal, T::NotEqual, T::Less, T::LessEq,
+                            T::Greater, T::GreaterEq, T::And, T::Or, T::Xor};
+    struct Case { std::vector<Token> graph; Token op; double (*rhs)(double); };
+    std::vector<Case> cases;
+    for (Token t : unary) cases.push_back({{t, T::LeftParen, T::VarX, T::RightParen}, t, nullptr});
+    for (Token t : binary) {
+        cases.push_back({{T::VarX, t, T::Num2}, t, [](double) { return 2.0; }});
+        cases.push_back({{T::VarX, t, T::Num0}, t, [](double) { return 0.0; }});
+        cases.push_back({{T::VarX, t, T::LeftParen, T::VarX, T::Sub, T::Num2, T::RightParen}, t, [](double x) { return x - 2.0; }});
+    }
+    for (const Case& c : cases)
+        for (bool optimize : {true, false}) {
+            const CompiledExpression expr(c.graph, optimize);
+            std::vector<double> ys(xs.size());
+            CHECK(expr.evaluateBatch(xs, ys));
+            for (size_t i = 0; i < xs.size(); ++i) {
+                const double want = interpreterReference(c.op, xs[i], c.rhs ? c.rhs(xs[i]) : 0.0);
+                const CalculationResult r = expr.evaluate(xs[i]);
+                const bool ok = r.success && same(r.value, want) && same(ys[i], want);
+                if (!ok) std::fprintf(stderr, "  %s at x=%.17g: %.17g / %.17g, want %.17g\n", disassemble(expr.program()).c_str(), xs[i], r.value, ys[i], want);
+                CHECK(ok);
+            }
+        }
+}
+
+// Batches that end partway through a 256-sample column, and registry programs that fall back to one sample at a
+// time, give exactly what evaluate() gives per sample
+void batchMatchesScalar() {
+    const CompiledExpression scalar({T::Sin, T::LeftParen, T::VarX, T::RightParen, T::Mul, T::VarX, T::Div, T::LeftParen,
+                                     T::VarX, T::Sub, T::Num1, T::RightParen, T::Add, T::Sqrt, T::LeftParen, T::VarX, T::RightParen});
+    MathStateMachine::setMatrix(T::MatB, Matrix(2, 2, {2.0, 0.0, 0.0, 3.0}));
+    const CompiledExpression registry({T::Det, T::LeftParen, T::MatB, T::RightParen, T::Mul, T::VarX, T::Add, T::VarX});
+    for (size_t n : {size_t{0}, size_t{1}, size_t{255}, size_t{257}, size_t{513}, size_t{1000}}) {
+        std::vector<double> xs(n), ys(n), zs(n);
+        for (size_t i = 0; i < n; ++i) xs[i] = -5.0 + 0.0173 * static_cast<double>(i);
+        CHECK(scalar.evaluateBatch(xs, ys) && registry.evaluateBatch(xs, zs));
+        for (size_t i = 0; i < n; ++i) {
+            CHECK(same(ys[i], scalar.evaluate(xs[i]).value));
+            CHECK(zs[i] == registry.evaluate(xs[i]).value && zs[i] == 6.0 * xs[i] + xs[i]);
+        }
+    }
+    // A registry error fails the whole batch the way it fails each sample
+    const CompiledExpression undefined({T::Det, T::LeftParen, T::MatJ, T::RightParen, T::Add, T::VarX});
+    std::vector<double> xs = {1.0, 2.0, 3.0}, ys(3, 0.0);
+    CHECK(!undefined.evaluateBatch(xs, ys) && std::isnan(ys[0]) && std::isnan(ys[2]));
+    const CalculationResult r = undefined.evaluate(1.0);
+    CHECK(!r.success && r.error_message == "Undefined Matrix");
+}
+
+// Empty and one-element lists give Stat Error where the TI-83 does, and sortA puts NaNs last
+void listEdgeCases() {
+    MathStateMachine::setList(T::List3, List());
+    MathStateMachine::setList(T::List4, List({5.0}));
+    auto run = [](Token fn, Token list) { return CompiledExpression({fn, T::LeftParen, list, T::RightParen}).evaluate(); };
+    CHECK(run(T::Sum, T::List3).success && run(T::Sum, T::List3).value == 0.0);
+    CHECK(!run(T::Mean, T::List3).success && run(T::Mean, T::List3).error_message == "Stat Error");
+    CHECK(!run(T::StdDev, T::List3).success && run(T::StdDev, T::List3).error_message == "Stat Error");
+    CHECK(run(T::SortA, T::List3).success && run(T::SortA, T::List3).listValue.size() == 0);
+    CHECK(run(T::CumSum, T::List3).success && run(T::CumSum, T::List3).listValue.size() == 0);
+    CHECK(run(T::Mean, T::List4).success && run(T::Mean, T::List4).value == 5.0);
+    CHECK(!run(T::StdDev, T::List4).success && run(T::StdDev, T::List4).error_message == "Stat Error");
+    const CalculationResult fit = CompiledExpression({T::LinReg, T::LeftParen, T::List4, T::Comma, T::List4, T::RightParen}).evaluate();
+    CHECK(!fit.success && fit.error_message == "Stat Error");
+
+    const double nan = std::nan("");
+    const List small = listSortA(List({3.0, nan, -1.0, nan, 2.0, -0.0}));
+    const std::vector<double> want = {-1.0, -0.0, 2.0, 3.0};
+    CHECK(small.size() == 6 && std::equal(want.begin(), want.end(), small.data()) && std::isnan(small.values()[4]) && std::isnan(small.values()[5]));
+
+    // Across the parallel merge passes too
+    std::vector<double> big(3 * kListChunk + 11);
+    for (size_t i = 0; i < big.size(); ++i) big[i] = i % 97 == 0 ? nan : static_cast<double>((i * 7919) % 100003);
+    const List sorted = listSortA(List(big));
+    const size_t nans = static_cast<size_t>(std::count_if(big.begin(), big.end(), [](double v) { return std::isnan(v); }));
+    const std::span<const double> v = sorted.values();
+    CHECK(std::is_sorted(v.begin(), v.end() - nans) && std::all_of(v.end() - nans, v.end(), [](double x) { return std::isnan(x); }));
+}
+
+// The three-pass parallel cumSum agrees with a serial running sum, exactly on integers and to rounding otherwise
+void cumSumMatchesSerial() {
+    const size_t n = kListParallelMin + 3 * kListChunk + 5;
+    std::vector<double> ints(n), reals(n);
+    for (size_t i = 0; i < n; ++i) {
+        ints[i] = static_cast<double>(static_cast<int>(i % 13) - 6);
+        reals[i] = std::sin(static_cast<double>(i)) * 1e3;
+    }
+    const List a = listCumSum(List(ints)), b = listCumSum(List(reals));
+    double si = 0, sr = 0, magnitude = 0;
+    bool exact = true, close = true;
+    for (size_t i = 0; i < n; ++i) {
+        si += ints[i];
+        sr += reals[i];
+        magnitude += std::abs(reals[i]);
+        exact = exact && a.values()[i] == si;
+        close = close && std::abs(b.values()[i] - sr) <= 1e-12 * magnitude;
+    }
+    CHECK(exact && close);
+}
+
+// List kernels called from inside a pool task run inline, rather than queueing behind one shared list pool
+void nestedParallelFor() {
+    std::vector<double> values(kListParallelMin + 1, 0.5);
+    const List list(values);
+    const double want = listSum(list);
+    ParallelSampler pool(3);
+    std::vector<double> sums(8);
+    pool.parallelFor(sums.size(), [&](size_t i) {
+        CHECK(ParallelSampler::inTask());
+        sums[i] = listSum(list);
+        pool.parallelFor(2, [&](size_t) {}); // The same pool, nested: would self-deadlock on its call lock
+    });
+    CHECK(!ParallelSampler::inTask());
+    for (double s : sums) CHECK(s == want);
+}
+
+// Text reaches the same Token stream the keypad would build, and evaluates to the TI-83's answer
+void tokenizerRoundTrip() {
+    const struct { const char* text; std::vector<Token> tokens; } streams[] = {
+        {"2X", {T::Num2, T::Mul, T::VarX}},
+        {"3(X+1)", {T::Num3, T::Mul, T::LeftParen, T::VarX, T::Add, T::Num1, T::RightParen}},
+        {"(X)(X)", {T::LeftParen, T::VarX, T::RightParen, T::Mul, T::LeftParen, T::VarX, T::RightParen}},
+        {"2sin(X", {T::Num2, T::Mul, T::Sin, T::LeftParen, T::VarX, T::RightParen}},
+        {"Xπ", {T::VarX, T::Mul, T::Pi}},
+        {"-X^2", {T::LeftParen, T::Num0, T::Sub, T::VarX, T::Pow, T::Num2, T::RightParen}},
+        {"2*−3", {T::Num2, T::Mul, T::LeftParen, T::Num0, T::Sub, T::Num3, T::RightParen}},
+        {"X²", {T::VarX, T::Pow, T::Num2}},
+        {"[A]ᵀ", {T::MatA, T::Transpose}},
+        {"[a]'", {T::MatA, T::Transpose}},
+        {"[J]⁻¹", {T::MatJ, T::Inverse}},
+        {"det([B]", {T::Det, T::LeftParen, T::MatB, T::RightParen}},
+        {"sum(L1)", {T::Sum, T::LeftParen, T::List1, T::RightParen}},
+        {"LinReg(l2, L6", {T::LinReg, T::LeftParen, T::List2, T::Comma, T::List6, T::RightParen}},
+        {"2L3", {T::Num2, T::Mul, T::List3}},
+        {"X<=1 and not(X=2)", {T::VarX, T::LessEq, T::Num1, T::And, T::Not, T::LeftParen, T::VarX, T::Equal, T::Num2, T::RightParen}},
+    };
+    for (const auto& c : streams) {
+        const TokenizeResult r = tokenize(c.text);
+        if (!r.success || r.tokens != c.tokens) std::fprintf(stderr, "  tokenize(\"%s\"): %s\n", c.text, r.error_message.c_str());
+        CHECK(r.success && r.tokens == c.tokens);
+    }
+
+    const struct { const char* text; double x, value; } values[] = {
+        {"-X^2", 3, -9}, {"-X²", 3, -9}, {"(-X)^2", 3, 9}, {"-2X", 4, -8}, {"3--2", 0, 5}, {"--X", 2, 2},
+        {"2X+1", 5, 11}, {"3(X+1)(X-1)", 2, 9}, {"-(X+1)", 1, -2}, {"2^-1", 0, 0.5}, {"2⁻¹", 0, 0.5},
+        {"√(16)+1", 0, 5}, {"1.5e-3*2", 0, 0.003}, {"+X", 7, 7},
+    };
+    for (const auto& c : values) {
+        const TokenizeResult r = tokenize(c.text);
+        const CalculationResult v = r.success ? CompiledExpression(r.tokens).evaluate(c.x) : CalculationResult{};
+        if (!v.success || std::abs(v.value - c.value) > 1e-15) std::fprintf(stderr, "  \"%s\" at X=%g: %.17g\n", c.text, c.x, v.value);
+        CHECK(v.success && std::abs(v.value - c.value) <= 1e-15);
+    }
+}
+
+// Malformed input names the problem and the byte where it starts
+void tokenizerErrors() {
+    const struct { const char* text; const char* message; size_t offset; } cases[] = {
+        {"", "Empty", 0},
+        {"   ", "Empty", 3},
+        {"2+", "Expected operand", 2},
+        {"*2", "Expected operand", 0},
+        {"(2+)", "Expected operand", 3},
+        {"2)", "Unmatched )", 1},
+        {"1..2", "Malformed number", 2},
+        {".", "Malformed number", 0},
+        {"foo", "Unknown name", 0},
+        {"sin X", "Expected ( after function", 0},
+        {"[K]", "Expected [A] through [J]", 0},
+        {"X+[A", "Expected [A] through [J]", 2},
+        {"1,2", "Unexpected ,", 1},
+        {"2#", "Unexpected character", 1},
+        {"ᵀ", "Expected operand", 0},
+    };
+    for (const auto& c : cases) {
+        const TokenizeResult r = tokenize(c.text);
+        if (r.success || r.error_message != c.message || r.errorOffset != c.offset)
+            std::fprintf(stderr, "  tokenize(\"%s\"): \"%s\" at %zu\n", c.text, r.error_message.c_str(), r.errorOffset);
+        CHECK(!r.success && r.error_message == c.message && r.errorOffset == c.offset && r.tokens.empty());
+    }
+}
+
+bool sameMatrix(const Matrix& a, const Matrix& b) {
+    return a.rows == b.rows && a.cols == b.cols && std::equal(a.data(), a.data() + a.size(), b.data());
+}
+
+// A write through any handle detaches it, so neither the registry nor a result ever sees another's edit
+void matrixAliasing() {
+    Matrix mine(2, 2, {1.0, 2.0, 3.0, 4.0});
+    const Matrix copy = mine;
+    CHECK(copy.sharesStorageWith(mine));
+    mine.set(0, 0, 9.0);
+    CHECK(!copy.sharesStorageWith(mine) && copy.at(0, 0) == 1.0 && mine.at(0, 0) == 9.0);
+
+    // Editing a matrix after storing it changes neither the published snapshot nor one pinned earlier
+    Matrix d(2, 2, {1.0, 2.0, 3.0, 4.0});
+    MathStateMachine::setMatrix(T::MatD, d);
+    const std::shared_ptr<const RegistrySnapshot> pinned = MathStateMachine::registry();
+    d.set(1, 1, -1.0);
+    CHECK(MathStateMachine::registry()->matrices.at(T::MatD).at(1, 1) == 4.0);
+    MathStateMachine::setMatrix(T::MatD, d);
+    CHECK(pinned->matrices.at(T::MatD).at(1, 1) == 4.0 && MathStateMachine::registry()->matrices.at(T::MatD).at(1, 1) == -1.0);
+    MathStateMachine::setMatrix(T::MatD, Matrix(2, 2, {1.0, 2.0, 3.0, 4.0}));
+
+    // Both operands of [D]+[D] are one handle; the sum, transpose and inverse all leave [D] as it was
+    const Matrix stored = MathStateMachine::registry()->matrices.at(T::MatD);
+    const Matrix original(2, 2, {1.0, 2.0, 3.0, 4.0});
+    const CalculationResult twice = CompiledExpression({T::MatD, T::Add, T::MatD}).evaluate();
+    CHECK(twice.isMatrix && sameMatrix(twice.matrixValue, Matrix(2, 2, {2.0, 4.0, 6.0, 8.0})));
+    CHECK(!twice.matrixValue.sharesStorageWith(stored));
+    const CalculationResult none = CompiledExpression({T::MatD, T::Sub, T::MatD}).evaluate();
+    CHECK(none.isMatrix && sameMatrix(none.matrixValue, Matrix(2, 2)));
+    const CalculationResult t = CompiledExpression({T::MatD, T::Transpose}).evaluate();
+    CHECK(t.isMatrix && sameMatrix(t.matrixValue, Matrix(2, 2, {1.0, 3.0, 2.0, 4.0})));
+    const CalculationResult inv = CompiledExpression({T::MatD, T::Inverse, T::Mul, T::MatD}).evaluate();
+    CHECK(inv.isMatrix && std::abs(inv.matrixValue.at(0, 0) - 1.0) < 1e-15 && std::abs(inv.matrixValue.at(1, 0)) < 1e-15);
+    CHECK(sameMatrix(MathStateMachine::registry()->matrices.at(T::MatD), original) && sameMatrix(stored, original));
+
+    // Lists share storage the same way: L5+L5 must not double L5 in place
+    MathStateMachine::setList(T::List5, List({1.0, 2.0}));
+    const CalculationResult sum = CompiledExpression({T::List5, T::Add, T::List5}).evaluate();
+    CHECK(sum.isList && sum.listValue.values()[1] == 4.0 && MathStateMachine::registry()->lists.at(T::List5).values()[1] == 2.0);
+}
+
+// Linear matrix expressions are fused into one pass; the result matches evaluating each operator on its own
+void matrixFusionMatchesUnfused() {
+    auto grid = [](int r, int c, double offset) {
+        std::vector<double> v(static_cast<size_t>(r) * c);
+        for (size_t i = 0; i < v.size(); ++i) v[i] = static_cast<double>(i % 17) * 0.25 - offset; // Exact in binary
+        return Matrix(r, c, v);
+    };
+    const Matrix e = grid(5, 5, 1.0), f = grid(5, 5, -3.5), g = grid(5, 5, 0.75);
+    MathStateMachine::setMatrix(T::MatE, e);
+    MathStateMachine::setMatrix(T::MatF, f);
+    MathStateMachine::setMatrix(T::MatG, g);
+
+    // 2[E]+3[F]-[E]-[G]×4
+    const std::vector<Token> linear = {T::Num2, T::Mul, T::MatE, T::Add, T::Num3, T::Mul, T::MatF, T::Sub, T::MatE, T::Sub, T::MatG, T::Mul, T::Num4};
+    const Matrix stepwise = matrixAdd(matrixAdd(matrixAdd(matrixScale(e, 2.0), matrixScale(f, 3.0)), matrixScale(e, -1.0)), matrixScale(g, -4.0));
+    // ([E]+[F])×[G]-[F]×2
+    const std::vector<Token> product = {T::LeftParen, T::MatE, T::Add, T::MatF, T::RightParen, T::Mul, T::MatG, T::Sub, T::MatF, T::Mul, T::Num2};
+    const Matrix productStepwise = matrixAdd(matrixMul(matrixAdd(e, f), g), matrixScale(f, -2.0));
+
+    for (bool optimize : {true, false}) {
+        const CalculationResult a = CompiledExpression(linear, optimize).evaluate();
+        CHECK(a.isMatrix && sameMatrix(a.matrixValue, stepwise));
+        const CalculationResult b = CompiledExpression(product, optimize).evaluate();
+        CHECK(b.isMatrix && sameMatrix(b.matrixValue, productStepwise));
+    }
+    CHECK(sameMatrix(MathStateMachine::registry()->matrices.at(T::MatE), e));
+}
+
+} // namespace
+
+int main() {
+    const std::pair<const char*, std::function<void()>> tests[] = {
+        {"inverseTrigMatchesLibm", inverseTrigMatchesLibm},
+        {"inverseTrigIntervals", inverseTrigIntervals},
+        {"adaptiveGuardBudget", adaptiveGuardBudget},
+        {"pinnedRegistrySampling", pinnedRegistrySampling},
+        {"sessionRoundTrip", sessionRoundTrip},
+        {"divisionByConstantIsExact", divisionByConstantIsExact},
+        {"optimizerGoldenPrograms", optimizerGoldenPrograms},
+        {"optimizerPreservesResults", optimizerPreservesResults},
+        {"luScaledAndSingular", luScaledAndSingular},
+        {"transposeShapes", transposeShapes},
+        {"vmMatchesInterpreter", vmMatchesInterpreter},
+        {"batchMatchesScalar", batchMatchesScalar},
+        {"listEdgeCases", listEdgeCases},
+        {"cumSumMatchesSerial", cumSumMatchesSerial},
+        {"nestedParallelFor", nestedParallelFor},
+        {"tokenizerRoundTrip", tokenizerRoundTrip},
+        {"tokenizerErrors", tokenizerErrors},
+        {"matrixAliasing", matrixAliasing},
+        {"matrixFusionMatchesUnfused", matrixFusionMatchesUnfused},
+    };
+    for (const auto& [name, test] : tests) {
+        const int before = g_failures;
+        test();
+        std::printf("%s %s\n", g_failures == before ? "PASS" : "FAIL", name);
+    }
+    return g_failures == 0 ? 0 : 1;
+}